@@ -0,0 +1,159 @@
+#pragma once
+
+// Host simulation of the subset of the ACL runtime (aclrt*/aclmdl*) this
+// project uses. Put acl_sim/ ahead of the SDK include path and link
+// acl_sim.cpp instead of libascendcl; see acl_sim/Makefile.
+//
+// Models run on the CPU with OpenCV DNN from the ONNX files the .om files
+// were converted from (see readme): backT.om, backX.om and head.om map to
+// nanotrack_backbone127.onnx, nanotrack_backbone255.onnx and
+// nanotrack_head.onnx, any other name.om to name.onnx. They are looked up in
+// ACL_SIM_ONNX_DIR, next to the .om file, then one directory up.
+//
+// Timing follows a simple device model so that concurrency and pipelining
+// behave as on the board:
+// - executions hold one of ACL_SIM_COMPUTE_UNITS (default 1) AI-core slots
+//   for at least the configured per-model latency;
+// - host/device copies hold the copy engine for count / bandwidth plus a
+//   fixed overhead;
+// - every stream has its own worker thread running its queue in order, so
+//   *Async calls return at once and aclrtSynchronizeStream waits for the
+//   queue; synchronous calls run in the calling thread;
+// - allocations, model loads and stream creation need a current context
+//   (aclrtSetDevice or aclrtSetCurrentContext) as on the real runtime.
+//
+// Environment, read by aclInit:
+//   ACL_SIM_ONNX_DIR           where the ONNX files are
+//   ACL_SIM_LATENCY_MS         e.g. "backT=1.9,backX=4.2,head=1.1" (.om names)
+//   ACL_SIM_MEMCPY_GBPS        copy bandwidth, default 2
+//   ACL_SIM_MEMCPY_OVERHEAD_US per copy, default 20
+//   ACL_SIM_COMPUTE_UNITS      concurrent executions, default 1
+//   ACL_SIM_COMPUTE=0          skip the CPU inference, outputs are zeros
+//   ACL_SIM_DEVICE_MB          device memory size, default 4096
+//   ACL_SIM_REPORT=1           print aclsimPrintStats() on aclFinalize
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef int aclError;
+typedef void* aclrtContext;
+typedef void* aclrtStream;
+
+typedef struct aclmdlDesc aclmdlDesc;
+typedef struct aclmdlDataset aclmdlDataset;
+typedef struct aclDataBuffer aclDataBuffer;
+
+typedef enum aclrtMemMallocPolicy {
+  ACL_MEM_MALLOC_HUGE_FIRST,
+  ACL_MEM_MALLOC_HUGE_ONLY,
+  ACL_MEM_MALLOC_NORMAL_ONLY
+} aclrtMemMallocPolicy;
+
+typedef enum aclrtMemcpyKind {
+  ACL_MEMCPY_HOST_TO_HOST,
+  ACL_MEMCPY_HOST_TO_DEVICE,
+  ACL_MEMCPY_DEVICE_TO_HOST,
+  ACL_MEMCPY_DEVICE_TO_DEVICE
+} aclrtMemcpyKind;
+
+#define ACL_SUCCESS 0
+#define ACL_ERROR_INVALID_PARAM 100000
+#define ACL_ERROR_UNINITIALIZE 100001
+#define ACL_ERROR_REPEAT_INITIALIZE 100002
+#define ACL_ERROR_INVALID_FILE 100003
+#define ACL_ERROR_INVALID_MODEL_ID 100010
+#define ACL_ERROR_READ_MODEL_FAILURE 100024
+#define ACL_ERROR_BAD_ALLOC 200000
+#define ACL_ERROR_INTERNAL_ERROR 500000
+#define ACL_ERROR_RT_CONTEXT_NULL 107002
+#define ACL_ERROR_RT_STREAM_CONTEXT 107021
+
+#define ACL_MAX_DIM_CNT 128
+#define ACL_MAX_TENSOR_NAME_LEN 128
+
+typedef struct aclmdlIODims {
+  char name[ACL_MAX_TENSOR_NAME_LEN];
+  size_t dimCount;
+  int64_t dims[ACL_MAX_DIM_CNT];
+} aclmdlIODims;
+
+aclError aclInit(const char* configPath);
+aclError aclFinalize();
+
+aclError aclrtSetDevice(int32_t deviceId);
+aclError aclrtResetDevice(int32_t deviceId);
+aclError aclrtCreateContext(aclrtContext* context, int32_t deviceId);
+aclError aclrtDestroyContext(aclrtContext context);
+aclError aclrtSetCurrentContext(aclrtContext context);
+aclError aclrtGetCurrentContext(aclrtContext* context);
+
+aclError aclrtCreateStream(aclrtStream* stream);
+aclError aclrtDestroyStream(aclrtStream stream);
+aclError aclrtSynchronizeStream(aclrtStream stream);
+
+aclError aclrtMalloc(void** devPtr, size_t size, aclrtMemMallocPolicy policy);
+aclError aclrtFree(void* devPtr);
+aclError aclrtMallocHost(void** hostPtr, size_t size);
+aclError aclrtFreeHost(void* hostPtr);
+aclError aclrtMemcpy(void* dst, size_t destMax, const void* src, size_t count,
+                     aclrtMemcpyKind kind);
+aclError aclrtMemcpyAsync(void* dst, size_t destMax, const void* src,
+                          size_t count, aclrtMemcpyKind kind,
+                          aclrtStream stream);
+
+aclError aclmdlQuerySize(const char* fileName, size_t* workSize,
+                         size_t* weightSize);
+aclError aclmdlLoadFromFile(const char* modelPath, uint32_t* modelId);
+aclError aclmdlLoadFromFileWithMem(const char* modelPath, uint32_t* modelId,
+                                   void* workPtr, size_t workSize,
+                                   void* weightPtr, size_t weightSize);
+aclError aclmdlUnload(uint32_t modelId);
+
+aclmdlDesc* aclmdlCreateDesc();
+aclError aclmdlDestroyDesc(aclmdlDesc* modelDesc);
+aclError aclmdlGetDesc(aclmdlDesc* modelDesc, uint32_t modelId);
+size_t aclmdlGetNumInputs(aclmdlDesc* modelDesc);
+size_t aclmdlGetNumOutputs(aclmdlDesc* modelDesc);
+size_t aclmdlGetInputSizeByIndex(aclmdlDesc* modelDesc, size_t index);
+size_t aclmdlGetOutputSizeByIndex(aclmdlDesc* modelDesc, size_t index);
+const char* aclmdlGetInputNameByIndex(const aclmdlDesc* modelDesc,
+                                      size_t index);
+const char* aclmdlGetOutputNameByIndex(const aclmdlDesc* modelDesc,
+                                       size_t index);
+aclError aclmdlGetInputDims(const aclmdlDesc* modelDesc, size_t index,
+                            aclmdlIODims* dims);
+aclError aclmdlGetOutputDims(const aclmdlDesc* modelDesc, size_t index,
+                             aclmdlIODims* dims);
+
+aclmdlDataset* aclmdlCreateDataset();
+aclError aclmdlDestroyDataset(const aclmdlDataset* dataset);
+aclError aclmdlAddDatasetBuffer(aclmdlDataset* dataset,
+                                aclDataBuffer* dataBuffer);
+size_t aclmdlGetDatasetNumBuffers(const aclmdlDataset* dataset);
+aclDataBuffer* aclmdlGetDatasetBuffer(const aclmdlDataset* dataset,
+                                      size_t index);
+
+aclDataBuffer* aclCreateDataBuffer(void* data, size_t size);
+aclError aclDestroyDataBuffer(const aclDataBuffer* dataBuffer);
+void* aclGetDataBufferAddr(const aclDataBuffer* dataBuffer);
+size_t aclGetDataBufferSizeV2(const aclDataBuffer* dataBuffer);
+
+aclError aclmdlExecute(uint32_t modelId, const aclmdlDataset* input,
+                       aclmdlDataset* output);
+aclError aclmdlExecuteAsync(uint32_t modelId, const aclmdlDataset* input,
+                            aclmdlDataset* output, aclrtStream stream);
+
+// Simulation controls, not part of ACL. aclInit applies the environment,
+// these override it when called afterwards.
+void aclsimSetModelLatency(const char* omName, double ms);
+void aclsimSetMemcpyBandwidth(double gbPerSecond, double overheadUs);
+void aclsimSetComputeUnits(int units);
+void aclsimPrintStats();
+
+#ifdef __cplusplus
+}
+#endif
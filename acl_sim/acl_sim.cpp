@@ -0,0 +1,1093 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <opencv2/dnn.hpp>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "acl.h"
+#include "onnx_info.h"
+
+#define SIM_LOG(fmt, ...) fprintf(stderr, "[ACL_SIM] " fmt "\n", ##__VA_ARGS__)
+
+typedef std::chrono::steady_clock Clock;
+
+namespace {
+
+const size_t DEVICE_ALIGN = 64;
+
+double msSince(Clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(Clock::now() - start)
+      .count();
+}
+
+void holdUntil(Clock::time_point start, double ms) {
+  std::this_thread::sleep_until(
+      start + std::chrono::duration_cast<Clock::duration>(
+                  std::chrono::duration<double, std::milli>(ms)));
+}
+
+// an engine of the simulated device, held for the duration of an operation
+class Engine {
+ public:
+  explicit Engine(int units) : units_(units), available_(units) {}
+
+  void setUnits(int units) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    available_ += units - units_;
+    units_ = units;
+    cv_.notify_all();
+  }
+  void acquire() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait(lock, [this] { return available_ > 0; });
+    --available_;
+  }
+  void release(double busy_ms) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++available_;
+    busy_ms_ += busy_ms;
+    cv_.notify_one();
+  }
+  int units() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return units_;
+  }
+  double busyMs() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return busy_ms_;
+  }
+
+ private:
+  mutable std::mutex mutex_;
+  std::condition_variable cv_;
+  int units_;
+  int available_;
+  double busy_ms_ = 0;
+};
+
+struct Context {
+  int32_t device;
+};
+
+struct Stream {
+  Context* context;
+  std::thread worker;
+  std::mutex mutex;
+  std::condition_variable work_cv;
+  std::condition_variable idle_cv;
+  std::deque<std::function<aclError()>> queue;
+  bool busy = false;
+  bool stop = false;
+  aclError error = ACL_SUCCESS;  // first failure since the last sync
+};
+
+struct Model {
+  std::string name;  // .om basename, the latency key
+  std::string onnx_path;
+  std::vector<OnnxTensorInfo> inputs;
+  std::vector<OnnxTensorInfo> outputs;
+  cv::dnn::Net net;
+  std::mutex net_mutex;  // cv::dnn::Net is not reentrant
+  void* own_memory = nullptr;  // aclmdlLoadFromFile allocates its own
+};
+
+struct ModelStats {
+  uint64_t executions = 0;
+  double total_ms = 0;
+  double max_ms = 0;
+  uint64_t overruns = 0;  // the CPU took longer than the configured latency
+};
+
+thread_local Context* t_context = nullptr;
+
+}  // namespace
+
+struct aclmdlDesc {
+  std::vector<OnnxTensorInfo> inputs;
+  std::vector<OnnxTensorInfo> outputs;
+};
+
+struct aclmdlDataset {
+  std::vector<aclDataBuffer*> buffers;
+};
+
+struct aclDataBuffer {
+  void* data;
+  size_t size;
+};
+
+namespace {
+
+struct Sim {
+  Sim() : compute(1), copy(1) {}
+
+  std::mutex mutex;
+  bool initialized = false;
+  Clock::time_point init_time;
+
+  // configuration
+  std::string onnx_dir;
+  std::map<std::string, double> latency_ms;
+  double gbps = 2.0;
+  double overhead_us = 20.0;
+  bool run_compute = true;
+  size_t device_capacity = size_t(4096) << 20;
+  bool report = false;
+
+  Engine compute;
+  Engine copy;
+
+  std::map<const char*, size_t> device_allocs;  // ordered for range lookup
+  std::set<void*> host_allocs;
+  size_t device_used = 0;
+  size_t device_peak = 0;
+
+  std::map<uint32_t, std::shared_ptr<Model>> models;
+  uint32_t next_model_id = 1;
+  std::map<std::string, ModelStats> model_stats;
+
+  std::set<Context*> contexts;
+  std::map<int32_t, Context*> default_contexts;
+  std::set<Stream*> streams;
+
+  uint64_t copies = 0;
+  uint64_t copy_bytes = 0;
+};
+
+Sim& sim() {
+  static Sim instance;
+  return instance;
+}
+
+size_t tensorBytes(const OnnxTensorInfo& tensor) {
+  size_t count = 1;
+  for (size_t i = 0; i < tensor.dims.size(); ++i) {
+    count *= static_cast<size_t>(tensor.dims[i]);
+  }
+  return count * sizeof(float);  // the models are converted as FP32
+}
+
+bool fileExists(const std::string& path) {
+  struct stat st;
+  return stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode);
+}
+
+std::string omName(const std::string& om_path) {
+  size_t slash = om_path.find_last_of('/');
+  std::string base =
+      slash == std::string::npos ? om_path : om_path.substr(slash + 1);
+  size_t dot = base.rfind(".om");
+  return dot == std::string::npos ? base : base.substr(0, dot);
+}
+
+std::string resolveOnnx(const std::string& om_path) {
+  static const char* const MAP[][2] = {
+      {"backT", "nanotrack_backbone127.onnx"},
+      {"backX", "nanotrack_backbone255.onnx"},
+      {"head", "nanotrack_head.onnx"},
+  };
+  std::string name = omName(om_path);
+  std::string onnx = name + ".onnx";
+  for (size_t i = 0; i < sizeof(MAP) / sizeof(MAP[0]); ++i) {
+    if (name == MAP[i][0]) {
+      onnx = MAP[i][1];
+    }
+  }
+  size_t slash = om_path.find_last_of('/');
+  std::string dir = slash == std::string::npos ? "." : om_path.substr(0, slash);
+  std::vector<std::string> dirs;
+  if (!sim().onnx_dir.empty()) {
+    dirs.push_back(sim().onnx_dir);
+  }
+  dirs.push_back(dir);
+  dirs.push_back(dir + "/..");
+  for (size_t i = 0; i < dirs.size(); ++i) {
+    if (fileExists(dirs[i] + "/" + onnx)) {
+      return dirs[i] + "/" + onnx;
+    }
+  }
+  return std::string();
+}
+
+// whether [ptr, ptr + size) lies in one device allocation; caller holds mutex
+bool isDevice(const void* ptr, size_t size) {
+  Sim& s = sim();
+  const char* p = static_cast<const char*>(ptr);
+  std::map<const char*, size_t>::iterator it = s.device_allocs.upper_bound(p);
+  if (it == s.device_allocs.begin()) {
+    return false;
+  }
+  --it;
+  return p + size <= it->first + it->second;
+}
+
+bool haveContext() { return t_context != nullptr; }
+
+aclError checkContext(const char* call) {
+  if (!sim().initialized) {
+    SIM_LOG("%s before aclInit", call);
+    return ACL_ERROR_UNINITIALIZE;
+  }
+  if (!haveContext()) {
+    SIM_LOG("%s without a current context on this thread", call);
+    return ACL_ERROR_RT_CONTEXT_NULL;
+  }
+  return ACL_SUCCESS;
+}
+
+aclError deviceMalloc(void** ptr, size_t size) {
+  Sim& s = sim();
+  std::lock_guard<std::mutex> lock(s.mutex);
+  if (s.device_used + size > s.device_capacity) {
+    SIM_LOG("device memory exhausted: %zu + %zu > %zu bytes", s.device_used,
+            size, s.device_capacity);
+    return ACL_ERROR_BAD_ALLOC;
+  }
+  if (posix_memalign(ptr, DEVICE_ALIGN, size == 0 ? 1 : size) != 0) {
+    return ACL_ERROR_BAD_ALLOC;
+  }
+  s.device_allocs[static_cast<const char*>(*ptr)] = size;
+  s.device_used += size;
+  s.device_peak = std::max(s.device_peak, s.device_used);
+  return ACL_SUCCESS;
+}
+
+aclError deviceFree(void* ptr) {
+  Sim& s = sim();
+  std::lock_guard<std::mutex> lock(s.mutex);
+  std::map<const char*, size_t>::iterator it =
+      s.device_allocs.find(static_cast<const char*>(ptr));
+  if (it == s.device_allocs.end()) {
+    SIM_LOG("aclrtFree of %p, not device memory", ptr);
+    return ACL_ERROR_INVALID_PARAM;
+  }
+  s.device_used -= it->second;
+  s.device_allocs.erase(it);
+  free(ptr);
+  return ACL_SUCCESS;
+}
+
+aclError doMemcpy(void* dst, size_t destMax, const void* src, size_t count,
+                  aclrtMemcpyKind kind) {
+  Sim& s = sim();
+  if (dst == nullptr || src == nullptr || count > destMax) {
+    return ACL_ERROR_INVALID_PARAM;
+  }
+  if (kind == ACL_MEMCPY_HOST_TO_HOST) {
+    memcpy(dst, src, count);
+    return ACL_SUCCESS;
+  }
+  {
+    std::lock_guard<std::mutex> lock(s.mutex);
+    bool src_device = kind == ACL_MEMCPY_DEVICE_TO_HOST ||
+                      kind == ACL_MEMCPY_DEVICE_TO_DEVICE;
+    bool dst_device = kind == ACL_MEMCPY_HOST_TO_DEVICE ||
+                      kind == ACL_MEMCPY_DEVICE_TO_DEVICE;
+    if ((src_device && !isDevice(src, count)) ||
+        (dst_device && !isDevice(dst, count))) {
+      SIM_LOG("memcpy kind %d with a pointer that is not device memory",
+              static_cast<int>(kind));
+      return ACL_ERROR_INVALID_PARAM;
+    }
+  }
+  double ms = s.overhead_us / 1000 + count / (s.gbps * 1e6);
+  s.copy.acquire();
+  Clock::time_point start = Clock::now();
+  memcpy(dst, src, count);
+  holdUntil(start, ms);
+  s.copy.release(msSince(start));
+  std::lock_guard<std::mutex> lock(s.mutex);
+  s.copies++;
+  s.copy_bytes += count;
+  return ACL_SUCCESS;
+}
+
+std::shared_ptr<Model> findModel(uint32_t modelId) {
+  Sim& s = sim();
+  std::lock_guard<std::mutex> lock(s.mutex);
+  std::map<uint32_t, std::shared_ptr<Model>>::iterator it =
+      s.models.find(modelId);
+  return it == s.models.end() ? std::shared_ptr<Model>() : it->second;
+}
+
+// the caller holds model.net_mutex
+aclError runNet(Model& model, const aclmdlDataset* input,
+                aclmdlDataset* output) {
+  try {
+    for (size_t i = 0; i < model.inputs.size(); ++i) {
+      std::vector<int> shape(model.inputs[i].dims.begin(),
+                             model.inputs[i].dims.end());
+      cv::Mat blob(shape, CV_32F, input->buffers[i]->data);
+      model.net.setInput(blob, model.inputs[i].name);
+    }
+    std::vector<cv::String> names;
+    for (size_t i = 0; i < model.outputs.size(); ++i) {
+      names.push_back(model.outputs[i].name);
+    }
+    std::vector<cv::Mat> outs;
+    model.net.forward(outs, names);
+    for (size_t i = 0; i < outs.size(); ++i) {
+      size_t bytes = outs[i].total() * outs[i].elemSize();
+      if (bytes > output->buffers[i]->size || !outs[i].isContinuous()) {
+        SIM_LOG("%s output %zu does not fit its buffer", model.name.c_str(), i);
+        return ACL_ERROR_INVALID_PARAM;
+      }
+      memcpy(output->buffers[i]->data, outs[i].data, bytes);
+    }
+  } catch (const cv::Exception& e) {
+    SIM_LOG("%s forward failed: %s", model.name.c_str(), e.what());
+    return ACL_ERROR_INTERNAL_ERROR;
+  }
+  return ACL_SUCCESS;
+}
+
+aclError doExecute(uint32_t modelId, const aclmdlDataset* input,
+                   aclmdlDataset* output) {
+  Sim& s = sim();
+  std::shared_ptr<Model> model = findModel(modelId);
+  if (!model) {
+    return ACL_ERROR_INVALID_MODEL_ID;
+  }
+  if (input == nullptr || output == nullptr ||
+      input->buffers.size() != model->inputs.size() ||
+      output->buffers.size() != model->outputs.size()) {
+    SIM_LOG("%s executed with the wrong number of buffers",
+            model->name.c_str());
+    return ACL_ERROR_INVALID_PARAM;
+  }
+  {
+    std::lock_guard<std::mutex> lock(s.mutex);
+    for (size_t i = 0; i < model->inputs.size(); ++i) {
+      if (!isDevice(input->buffers[i]->data, tensorBytes(model->inputs[i]))) {
+        SIM_LOG("%s input %zu is not device memory of %zu bytes",
+                model->name.c_str(), i, tensorBytes(model->inputs[i]));
+        return ACL_ERROR_INVALID_PARAM;
+      }
+    }
+    for (size_t i = 0; i < model->outputs.size(); ++i) {
+      if (!isDevice(output->buffers[i]->data,
+                    tensorBytes(model->outputs[i]))) {
+        SIM_LOG("%s output %zu is not device memory of %zu bytes",
+                model->name.c_str(), i, tensorBytes(model->outputs[i]));
+        return ACL_ERROR_INVALID_PARAM;
+      }
+    }
+  }
+  double target_ms;
+  {
+    std::lock_guard<std::mutex> lock(s.mutex);
+    std::map<std::string, double>::const_iterator it =
+        s.latency_ms.find(model->name);
+    target_ms = it == s.latency_ms.end() ? 0 : it->second;
+  }
+
+  // The net lock is taken before the compute slot and dropped once the
+  // forward is done: a stream waiting for the model's (host-side) net must
+  // not hold a unit meanwhile, that would show up as utilisation. Executions
+  // of one model still overlap in the modelled latency after the forward.
+  std::unique_lock<std::mutex> net_lock(model->net_mutex, std::defer_lock);
+  if (s.run_compute) {
+    net_lock.lock();
+  }
+  s.compute.acquire();
+  Clock::time_point start = Clock::now();
+  aclError ret = ACL_SUCCESS;
+  if (s.run_compute) {
+    ret = runNet(*model, input, output);
+    net_lock.unlock();
+  } else {
+    for (size_t i = 0; i < output->buffers.size(); ++i) {
+      memset(output->buffers[i]->data, 0, output->buffers[i]->size);
+    }
+  }
+  double cpu_ms = msSince(start);
+  holdUntil(start, target_ms);
+  double ms = msSince(start);
+  s.compute.release(ms);
+
+  std::lock_guard<std::mutex> lock(s.mutex);
+  ModelStats& stats = s.model_stats[model->name];
+  stats.executions++;
+  stats.total_ms += ms;
+  stats.max_ms = std::max(stats.max_ms, ms);
+  if (target_ms > 0 && cpu_ms > target_ms) {
+    stats.overruns++;
+  }
+  return ret;
+}
+
+void streamLoop(Stream* stream) {
+  for (;;) {
+    std::function<aclError()> task;
+    {
+      std::unique_lock<std::mutex> lock(stream->mutex);
+      stream->work_cv.wait(
+          lock, [stream] { return stream->stop || !stream->queue.empty(); });
+      if (stream->queue.empty()) {
+        return;
+      }
+      task = stream->queue.front();
+      stream->queue.pop_front();
+      stream->busy = true;
+    }
+    aclError ret = task();
+    std::lock_guard<std::mutex> lock(stream->mutex);
+    if (ret != ACL_SUCCESS && stream->error == ACL_SUCCESS) {
+      stream->error = ret;
+    }
+    stream->busy = false;
+    if (stream->queue.empty()) {
+      stream->idle_cv.notify_all();
+    }
+  }
+}
+
+aclError enqueue(aclrtStream handle, std::function<aclError()> task) {
+  Stream* stream = static_cast<Stream*>(handle);
+  {
+    std::lock_guard<std::mutex> lock(sim().mutex);
+    if (!sim().streams.count(stream)) {
+      return ACL_ERROR_INVALID_PARAM;
+    }
+  }
+  if (stream->context != t_context) {
+    SIM_LOG("stream used outside the context it was created in");
+    return ACL_ERROR_RT_STREAM_CONTEXT;
+  }
+  std::lock_guard<std::mutex> lock(stream->mutex);
+  stream->queue.push_back(task);
+  stream->work_cv.notify_one();
+  return ACL_SUCCESS;
+}
+
+void parseLatencies(const char* spec) {
+  std::stringstream items(spec);
+  std::string item;
+  while (std::getline(items, item, ',')) {
+    size_t eq = item.find('=');
+    if (eq == std::string::npos) {
+      SIM_LOG("ignoring latency entry '%s'", item.c_str());
+      continue;
+    }
+    sim().latency_ms[item.substr(0, eq)] = atof(item.c_str() + eq + 1);
+  }
+}
+
+aclError loadModel(const char* modelPath, uint32_t* modelId,
+                   void* own_memory) {
+  std::string onnx = resolveOnnx(modelPath);
+  if (onnx.empty()) {
+    SIM_LOG("no ONNX model found for %s", modelPath);
+    return ACL_ERROR_INVALID_FILE;
+  }
+  std::shared_ptr<Model> model = std::make_shared<Model>();
+  model->name = omName(modelPath);
+  model->onnx_path = onnx;
+  model->own_memory = own_memory;
+  if (!readOnnxInfo(onnx, model->inputs, model->outputs)) {
+    SIM_LOG("cannot read the graph of %s", onnx.c_str());
+    return ACL_ERROR_READ_MODEL_FAILURE;
+  }
+  if (sim().run_compute) {
+    try {
+      model->net = cv::dnn::readNetFromONNX(onnx);
+      model->net.setPreferableBackend(cv::dnn::DNN_BACKEND_OPENCV);
+      model->net.setPreferableTarget(cv::dnn::DNN_TARGET_CPU);
+    } catch (const cv::Exception& e) {
+      SIM_LOG("loading %s failed: %s", onnx.c_str(), e.what());
+      return ACL_ERROR_READ_MODEL_FAILURE;
+    }
+  }
+  Sim& s = sim();
+  std::lock_guard<std::mutex> lock(s.mutex);
+  *modelId = s.next_model_id++;
+  s.models[*modelId] = model;
+  return ACL_SUCCESS;
+}
+
+}  // namespace
+
+extern "C" {
+
+aclError aclInit(const char* configPath) {
+  (void)configPath;
+  Sim& s = sim();
+  std::lock_guard<std::mutex> lock(s.mutex);
+  if (s.initialized) {
+    return ACL_ERROR_REPEAT_INITIALIZE;
+  }
+  const char* value;
+  if ((value = getenv("ACL_SIM_ONNX_DIR")) != nullptr) {
+    s.onnx_dir = value;
+  }
+  if ((value = getenv("ACL_SIM_LATENCY_MS")) != nullptr) {
+    parseLatencies(value);
+  }
+  if ((value = getenv("ACL_SIM_MEMCPY_GBPS")) != nullptr && atof(value) > 0) {
+    s.gbps = atof(value);
+  }
+  if ((value = getenv("ACL_SIM_MEMCPY_OVERHEAD_US")) != nullptr) {
+    s.overhead_us = atof(value);
+  }
+  if ((value = getenv("ACL_SIM_COMPUTE_UNITS")) != nullptr && atoi(value) > 0) {
+    s.compute.setUnits(atoi(value));
+  }
+  if ((value = getenv("ACL_SIM_COMPUTE")) != nullptr) {
+    s.run_compute = atoi(value) != 0;
+  }
+  if ((value = getenv("ACL_SIM_DEVICE_MB")) != nullptr) {
+    s.device_capacity = static_cast<size_t>(atoll(value)) << 20;
+  }
+  if ((value = getenv("ACL_SIM_REPORT")) != nullptr) {
+    s.report = atoi(value) != 0;
+  }
+  s.initialized = true;
+  s.init_time = Clock::now();
+  return ACL_SUCCESS;
+}
+
+aclError aclFinalize() {
+  if (!sim().initialized) {
+    return ACL_ERROR_UNINITIALIZE;
+  }
+  if (sim().report) {
+    aclsimPrintStats();
+  }
+  std::lock_guard<std::mutex> lock(sim().mutex);
+  sim().initialized = false;
+  return ACL_SUCCESS;
+}
+
+aclError aclrtSetDevice(int32_t deviceId) {
+  Sim& s = sim();
+  std::lock_guard<std::mutex> lock(s.mutex);
+  if (!s.initialized) {
+    return ACL_ERROR_UNINITIALIZE;
+  }
+  if (deviceId != 0) {
+    return ACL_ERROR_INVALID_PARAM;
+  }
+  Context*& context = s.default_contexts[deviceId];
+  if (context == nullptr) {
+    context = new Context();
+    context->device = deviceId;
+    s.contexts.insert(context);
+  }
+  t_context = context;
+  return ACL_SUCCESS;
+}
+
+aclError aclrtResetDevice(int32_t deviceId) {
+  Sim& s = sim();
+  std::lock_guard<std::mutex> lock(s.mutex);
+  std::map<int32_t, Context*>::iterator it = s.default_contexts.find(deviceId);
+  if (it == s.default_contexts.end()) {
+    return ACL_SUCCESS;
+  }
+  if (t_context == it->second) {
+    t_context = nullptr;
+  }
+  s.contexts.erase(it->second);
+  delete it->second;
+  s.default_contexts.erase(it);
+  return ACL_SUCCESS;
+}
+
+aclError aclrtCreateContext(aclrtContext* context, int32_t deviceId) {
+  Sim& s = sim();
+  std::lock_guard<std::mutex> lock(s.mutex);
+  if (!s.initialized) {
+    return ACL_ERROR_UNINITIALIZE;
+  }
+  if (context == nullptr || deviceId != 0) {
+    return ACL_ERROR_INVALID_PARAM;
+  }
+  Context* created = new Context();
+  created->device = deviceId;
+  s.contexts.insert(created);
+  // as on the device, the new context becomes current for this thread
+  t_context = created;
+  *context = created;
+  return ACL_SUCCESS;
+}
+
+aclError aclrtDestroyContext(aclrtContext context) {
+  Sim& s = sim();
+  std::lock_guard<std::mutex> lock(s.mutex);
+  Context* c = static_cast<Context*>(context);
+  if (!s.contexts.erase(c)) {
+    return ACL_ERROR_INVALID_PARAM;
+  }
+  if (t_context == c) {
+    t_context = nullptr;
+  }
+  delete c;
+  return ACL_SUCCESS;
+}
+
+aclError aclrtSetCurrentContext(aclrtContext context) {
+  std::lock_guard<std::mutex> lock(sim().mutex);
+  Context* c = static_cast<Context*>(context);
+  if (!sim().contexts.count(c)) {
+    return ACL_ERROR_INVALID_PARAM;
+  }
+  t_context = c;
+  return ACL_SUCCESS;
+}
+
+aclError aclrtGetCurrentContext(aclrtContext* context) {
+  if (context == nullptr) {
+    return ACL_ERROR_INVALID_PARAM;
+  }
+  if (t_context == nullptr) {
+    return ACL_ERROR_RT_CONTEXT_NULL;
+  }
+  *context = t_context;
+  return ACL_SUCCESS;
+}
+
+aclError aclrtCreateStream(aclrtStream* stream) {
+  aclError ret = checkContext("aclrtCreateStream");
+  if (ret != ACL_SUCCESS) {
+    return ret;
+  }
+  if (stream == nullptr) {
+    return ACL_ERROR_INVALID_PARAM;
+  }
+  Stream* created = new Stream();
+  created->context = t_context;
+  created->worker = std::thread(streamLoop, created);
+  std::lock_guard<std::mutex> lock(sim().mutex);
+  sim().streams.insert(created);
+  *stream = created;
+  return ACL_SUCCESS;
+}
+
+aclError aclrtDestroyStream(aclrtStream stream) {
+  Stream* s = static_cast<Stream*>(stream);
+  {
+    std::lock_guard<std::mutex> lock(sim().mutex);
+    if (!sim().streams.erase(s)) {
+      return ACL_ERROR_INVALID_PARAM;
+    }
+  }
+  // queued work still runs, as on the device
+  {
+    std::lock_guard<std::mutex> lock(s->mutex);
+    s->stop = true;
+    s->work_cv.notify_one();
+  }
+  s->worker.join();
+  delete s;
+  return ACL_SUCCESS;
+}
+
+aclError aclrtSynchronizeStream(aclrtStream stream) {
+  Stream* s = static_cast<Stream*>(stream);
+  {
+    std::lock_guard<std::mutex> lock(sim().mutex);
+    if (!sim().streams.count(s)) {
+      return ACL_ERROR_INVALID_PARAM;
+    }
+  }
+  std::unique_lock<std::mutex> lock(s->mutex);
+  s->idle_cv.wait(lock, [s] { return s->queue.empty() && !s->busy; });
+  aclError ret = s->error;
+  s->error = ACL_SUCCESS;
+  return ret;
+}
+
+aclError aclrtMalloc(void** devPtr, size_t size, aclrtMemMallocPolicy policy) {
+  (void)policy;
+  aclError ret = checkContext("aclrtMalloc");
+  if (ret != ACL_SUCCESS) {
+    return ret;
+  }
+  if (devPtr == nullptr) {
+    return ACL_ERROR_INVALID_PARAM;
+  }
+  return deviceMalloc(devPtr, size);
+}
+
+aclError aclrtFree(void* devPtr) {
+  if (devPtr == nullptr) {
+    return ACL_ERROR_INVALID_PARAM;
+  }
+  return deviceFree(devPtr);
+}
+
+aclError aclrtMallocHost(void** hostPtr, size_t size) {
+  aclError ret = checkContext("aclrtMallocHost");
+  if (ret != ACL_SUCCESS) {
+    return ret;
+  }
+  if (hostPtr == nullptr ||
+      posix_memalign(hostPtr, DEVICE_ALIGN, size == 0 ? 1 : size) != 0) {
+    return ACL_ERROR_BAD_ALLOC;
+  }
+  std::lock_guard<std::mutex> lock(sim().mutex);
+  sim().host_allocs.insert(*hostPtr);
+  return ACL_SUCCESS;
+}
+
+aclError aclrtFreeHost(void* hostPtr) {
+  {
+    std::lock_guard<std::mutex> lock(sim().mutex);
+    if (!sim().host_allocs.erase(hostPtr)) {
+      SIM_LOG("aclrtFreeHost of %p, not from aclrtMallocHost", hostPtr);
+      return ACL_ERROR_INVALID_PARAM;
+    }
+  }
+  free(hostPtr);
+  return ACL_SUCCESS;
+}
+
+aclError aclrtMemcpy(void* dst, size_t destMax, const void* src, size_t count,
+                     aclrtMemcpyKind kind) {
+  aclError ret = checkContext("aclrtMemcpy");
+  if (ret != ACL_SUCCESS) {
+    return ret;
+  }
+  return doMemcpy(dst, destMax, src, count, kind);
+}
+
+aclError aclrtMemcpyAsync(void* dst, size_t destMax, const void* src,
+                          size_t count, aclrtMemcpyKind kind,
+                          aclrtStream stream) {
+  aclError ret = checkContext("aclrtMemcpyAsync");
+  if (ret != ACL_SUCCESS) {
+    return ret;
+  }
+  if (stream == nullptr) {
+    // default stream, completes before returning
+    return doMemcpy(dst, destMax, src, count, kind);
+  }
+  return enqueue(stream, [=] {
+    return doMemcpy(dst, destMax, src, count, kind);
+  });
+}
+
+aclError aclmdlQuerySize(const char* fileName, size_t* workSize,
+                         size_t* weightSize) {
+  if (fileName == nullptr || workSize == nullptr || weightSize == nullptr) {
+    return ACL_ERROR_INVALID_PARAM;
+  }
+  std::string onnx = resolveOnnx(fileName);
+  std::vector<OnnxTensorInfo> inputs, outputs;
+  if (onnx.empty() || !readOnnxInfo(onnx, inputs, outputs)) {
+    SIM_LOG("no readable ONNX model for %s", fileName);
+    return ACL_ERROR_INVALID_FILE;
+  }
+  // stand-ins: the weights are as big as the ONNX file, the work memory as
+  // all inputs and outputs together
+  struct stat st;
+  stat(onnx.c_str(), &st);
+  *weightSize = static_cast<size_t>(st.st_size);
+  *workSize = 0;
+  for (size_t i = 0; i < inputs.size(); ++i) {
+    *workSize += tensorBytes(inputs[i]);
+  }
+  for (size_t i = 0; i < outputs.size(); ++i) {
+    *workSize += tensorBytes(outputs[i]);
+  }
+  return ACL_SUCCESS;
+}
+
+aclError aclmdlLoadFromFile(const char* modelPath, uint32_t* modelId) {
+  aclError ret = checkContext("aclmdlLoadFromFile");
+  if (ret != ACL_SUCCESS) {
+    return ret;
+  }
+  if (modelPath == nullptr || modelId == nullptr) {
+    return ACL_ERROR_INVALID_PARAM;
+  }
+  size_t work, weight;
+  ret = aclmdlQuerySize(modelPath, &work, &weight);
+  if (ret != ACL_SUCCESS) {
+    return ret;
+  }
+  void* memory;
+  ret = deviceMalloc(&memory, work + weight);
+  if (ret != ACL_SUCCESS) {
+    return ret;
+  }
+  ret = loadModel(modelPath, modelId, memory);
+  if (ret != ACL_SUCCESS) {
+    deviceFree(memory);
+  }
+  return ret;
+}
+
+aclError aclmdlLoadFromFileWithMem(const char* modelPath, uint32_t* modelId,
+                                   void* workPtr, size_t workSize,
+                                   void* weightPtr, size_t weightSize) {
+  aclError ret = checkContext("aclmdlLoadFromFileWithMem");
+  if (ret != ACL_SUCCESS) {
+    return ret;
+  }
+  if (modelPath == nullptr || modelId == nullptr) {
+    return ACL_ERROR_INVALID_PARAM;
+  }
+  size_t need_work, need_weight;
+  ret = aclmdlQuerySize(modelPath, &need_work, &need_weight);
+  if (ret != ACL_SUCCESS) {
+    return ret;
+  }
+  {
+    std::lock_guard<std::mutex> lock(sim().mutex);
+    if (workSize < need_work || weightSize < need_weight ||
+        !isDevice(workPtr, need_work) || !isDevice(weightPtr, need_weight)) {
+      SIM_LOG("model memory for %s missing or too small", modelPath);
+      return ACL_ERROR_INVALID_PARAM;
+    }
+  }
+  return loadModel(modelPath, modelId, nullptr);
+}
+
+aclError aclmdlUnload(uint32_t modelId) {
+  std::shared_ptr<Model> model;
+  {
+    std::lock_guard<std::mutex> lock(sim().mutex);
+    std::map<uint32_t, std::shared_ptr<Model>>::iterator it =
+        sim().models.find(modelId);
+    if (it == sim().models.end()) {
+      return ACL_ERROR_INVALID_MODEL_ID;
+    }
+    model = it->second;
+    sim().models.erase(it);
+  }
+  if (model->own_memory != nullptr) {
+    deviceFree(model->own_memory);
+  }
+  return ACL_SUCCESS;
+}
+
+aclmdlDesc* aclmdlCreateDesc() { return new aclmdlDesc(); }
+
+aclError aclmdlDestroyDesc(aclmdlDesc* modelDesc) {
+  if (modelDesc == nullptr) {
+    return ACL_ERROR_INVALID_PARAM;
+  }
+  delete modelDesc;
+  return ACL_SUCCESS;
+}
+
+aclError aclmdlGetDesc(aclmdlDesc* modelDesc, uint32_t modelId) {
+  std::shared_ptr<Model> model = findModel(modelId);
+  if (modelDesc == nullptr) {
+    return ACL_ERROR_INVALID_PARAM;
+  }
+  if (!model) {
+    return ACL_ERROR_INVALID_MODEL_ID;
+  }
+  modelDesc->inputs = model->inputs;
+  modelDesc->outputs = model->outputs;
+  return ACL_SUCCESS;
+}
+
+size_t aclmdlGetNumInputs(aclmdlDesc* modelDesc) {
+  return modelDesc == nullptr ? 0 : modelDesc->inputs.size();
+}
+
+size_t aclmdlGetNumOutputs(aclmdlDesc* modelDesc) {
+  return modelDesc == nullptr ? 0 : modelDesc->outputs.size();
+}
+
+size_t aclmdlGetInputSizeByIndex(aclmdlDesc* modelDesc, size_t index) {
+  if (modelDesc == nullptr || index >= modelDesc->inputs.size()) {
+    return 0;
+  }
+  return tensorBytes(modelDesc->inputs[index]);
+}
+
+size_t aclmdlGetOutputSizeByIndex(aclmdlDesc* modelDesc, size_t index) {
+  if (modelDesc == nullptr || index >= modelDesc->outputs.size()) {
+    return 0;
+  }
+  return tensorBytes(modelDesc->outputs[index]);
+}
+
+const char* aclmdlGetInputNameByIndex(const aclmdlDesc* modelDesc,
+                                      size_t index) {
+  if (modelDesc == nullptr || index >= modelDesc->inputs.size()) {
+    return "";
+  }
+  return modelDesc->inputs[index].name.c_str();
+}
+
+const char* aclmdlGetOutputNameByIndex(const aclmdlDesc* modelDesc,
+                                       size_t index) {
+  if (modelDesc == nullptr || index >= modelDesc->outputs.size()) {
+    return "";
+  }
+  return modelDesc->outputs[index].name.c_str();
+}
+
+static aclError fillDims(const OnnxTensorInfo& tensor, aclmdlIODims* dims) {
+  if (tensor.dims.size() > ACL_MAX_DIM_CNT) {
+    return ACL_ERROR_INVALID_PARAM;
+  }
+  snprintf(dims->name, sizeof(dims->name), "%s", tensor.name.c_str());
+  dims->dimCount = tensor.dims.size();
+  for (size_t i = 0; i < tensor.dims.size(); ++i) {
+    dims->dims[i] = tensor.dims[i];
+  }
+  return ACL_SUCCESS;
+}
+
+aclError aclmdlGetInputDims(const aclmdlDesc* modelDesc, size_t index,
+                            aclmdlIODims* dims) {
+  if (modelDesc == nullptr || dims == nullptr ||
+      index >= modelDesc->inputs.size()) {
+    return ACL_ERROR_INVALID_PARAM;
+  }
+  return fillDims(modelDesc->inputs[index], dims);
+}
+
+aclError aclmdlGetOutputDims(const aclmdlDesc* modelDesc, size_t index,
+                             aclmdlIODims* dims) {
+  if (modelDesc == nullptr || dims == nullptr ||
+      index >= modelDesc->outputs.size()) {
+    return ACL_ERROR_INVALID_PARAM;
+  }
+  return fillDims(modelDesc->outputs[index], dims);
+}
+
+aclmdlDataset* aclmdlCreateDataset() { return new aclmdlDataset(); }
+
+aclError aclmdlDestroyDataset(const aclmdlDataset* dataset) {
+  if (dataset == nullptr) {
+    return ACL_ERROR_INVALID_PARAM;
+  }
+  // the data buffers are owned by the caller
+  delete dataset;
+  return ACL_SUCCESS;
+}
+
+aclError aclmdlAddDatasetBuffer(aclmdlDataset* dataset,
+                                aclDataBuffer* dataBuffer) {
+  if (dataset == nullptr || dataBuffer == nullptr) {
+    return ACL_ERROR_INVALID_PARAM;
+  }
+  dataset->buffers.push_back(dataBuffer);
+  return ACL_SUCCESS;
+}
+
+size_t aclmdlGetDatasetNumBuffers(const aclmdlDataset* dataset) {
+  return dataset == nullptr ? 0 : dataset->buffers.size();
+}
+
+aclDataBuffer* aclmdlGetDatasetBuffer(const aclmdlDataset* dataset,
+                                      size_t index) {
+  if (dataset == nullptr || index >= dataset->buffers.size()) {
+    return nullptr;
+  }
+  return dataset->buffers[index];
+}
+
+aclDataBuffer* aclCreateDataBuffer(void* data, size_t size) {
+  aclDataBuffer* buffer = new aclDataBuffer();
+  buffer->data = data;
+  buffer->size = size;
+  return buffer;
+}
+
+aclError aclDestroyDataBuffer(const aclDataBuffer* dataBuffer) {
+  if (dataBuffer == nullptr) {
+    return ACL_ERROR_INVALID_PARAM;
+  }
+  delete dataBuffer;
+  return ACL_SUCCESS;
+}
+
+void* aclGetDataBufferAddr(const aclDataBuffer* dataBuffer) {
+  return dataBuffer == nullptr ? nullptr : dataBuffer->data;
+}
+
+size_t aclGetDataBufferSizeV2(const aclDataBuffer* dataBuffer) {
+  return dataBuffer == nullptr ? 0 : dataBuffer->size;
+}
+
+aclError aclmdlExecute(uint32_t modelId, const aclmdlDataset* input,
+                       aclmdlDataset* output) {
+  aclError ret = checkContext("aclmdlExecute");
+  if (ret != ACL_SUCCESS) {
+    return ret;
+  }
+  return doExecute(modelId, input, output);
+}
+
+aclError aclmdlExecuteAsync(uint32_t modelId, const aclmdlDataset* input,
+                            aclmdlDataset* output, aclrtStream stream) {
+  aclError ret = checkContext("aclmdlExecuteAsync");
+  if (ret != ACL_SUCCESS) {
+    return ret;
+  }
+  if (stream == nullptr) {
+    return doExecute(modelId, input, output);
+  }
+  return enqueue(stream,
+                 [=] { return doExecute(modelId, input, output); });
+}
+
+void aclsimSetModelLatency(const char* omName, double ms) {
+  std::lock_guard<std::mutex> lock(sim().mutex);
+  sim().latency_ms[omName] = ms;
+}
+
+void aclsimSetMemcpyBandwidth(double gbPerSecond, double overheadUs) {
+  std::lock_guard<std::mutex> lock(sim().mutex);
+  if (gbPerSecond > 0) {
+    sim().gbps = gbPerSecond;
+  }
+  sim().overhead_us = overheadUs;
+}
+
+void aclsimSetComputeUnits(int units) {
+  if (units > 0) {
+    sim().compute.setUnits(units);
+  }
+}
+
+void aclsimPrintStats() {
+  Sim& s = sim();
+  double wall_ms = msSince(s.init_time);
+  std::lock_guard<std::mutex> lock(s.mutex);
+  for (std::map<std::string, ModelStats>::const_iterator it =
+           s.model_stats.begin();
+       it != s.model_stats.end(); ++it) {
+    const ModelStats& m = it->second;
+    double target = s.latency_ms.count(it->first) ? s.latency_ms[it->first] : 0;
+    fprintf(stderr,
+            "[ACL_SIM] model %-8s runs %-8llu avg %7.2f ms max %7.2f ms "
+            "target %6.2f ms overruns %llu\n",
+            it->first.c_str(), static_cast<unsigned long long>(m.executions),
+            m.executions ? m.total_ms / m.executions : 0, m.max_ms, target,
+            static_cast<unsigned long long>(m.overruns));
+  }
+  fprintf(stderr,
+          "[ACL_SIM] compute %d unit(s) busy %.1f%%, copy engine busy %.1f%% "
+          "(%llu copies, %.1f MB)\n",
+          s.compute.units(),
+          wall_ms > 0 ? 100 * s.compute.busyMs() / (wall_ms * s.compute.units())
+                      : 0,
+          wall_ms > 0 ? 100 * s.copy.busyMs() / wall_ms : 0,
+          static_cast<unsigned long long>(s.copies), s.copy_bytes / 1e6);
+  fprintf(stderr, "[ACL_SIM] device memory peak %.1f MB of %.1f MB\n",
+          s.device_peak / 1e6, s.device_capacity / 1e6);
+}
+
+}  // extern "C"
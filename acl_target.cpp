@@ -0,0 +1,124 @@
+#include "acl_target.h"
+
+NanoTrackModels::NanoTrackModels(const std::string& Tback_model,
+                                 const std::string& Xback_model,
+                                 const std::string& Head_model)
+    : T_path(Tback_model),
+      X_path(Xback_model),
+      head_path(Head_model),
+      module_T127(T_path.c_str(), "backT"),
+      module_X255(X_path.c_str(), "backX"),
+      module_head(head_path.c_str(), "head") {}
+
+Result NanoTrackModels::querySize(const std::string& Tback_model,
+                                  const std::string& Xback_model,
+                                  const std::string& Head_model,
+                                  size_t& device_bytes) {
+  const std::string* paths[] = {&Tback_model, &Xback_model, &Head_model};
+  device_bytes = 0;
+  for (size_t i = 0; i < 3; ++i) {
+    size_t work = 0;
+    size_t weight = 0;
+    aclError ret = aclmdlQuerySize(paths[i]->c_str(), &work, &weight);
+    if (ret != ACL_SUCCESS) {
+      ERROR_LOG("query model failed, model file is %s, errorCode is %d",
+                paths[i]->c_str(), static_cast<int32_t>(ret));
+      return FAILED;
+    }
+    device_bytes += work + weight;
+  }
+  return SUCCESS;
+}
+
+Result NanoTrackModels::initsource() {
+  Result ret;
+
+  // a set with a model that failed to load must never be published
+  if (!module_T127.loaded() || !module_X255.loaded() ||
+      !module_head.loaded()) {
+    ERROR_LOG("model set %s %s %s did not load", T_path.c_str(),
+              X_path.c_str(), head_path.c_str());
+    return FAILED;
+  }
+
+  ret = module_T127.backbone_initDatasets();
+  if (ret != SUCCESS) {
+    ERROR_LOG("module_T127.backbone_initDatasets failed ");
+    return FAILED;
+  }
+  ret = module_X255.backbone_initDatasets();
+  if (ret != SUCCESS) {
+    ERROR_LOG("module_X255.backbone_initDatasets failed ");
+    return FAILED;
+  }
+  ret = module_head.head_initDatasets();
+  if (ret != SUCCESS) {
+    ERROR_LOG("module_head.head_initDatasets failed ");
+    return FAILED;
+  }
+  return SUCCESS;
+}
+
+AclTarget::AclTarget(std::shared_ptr<NanoTrackModels> models)
+    : name_("npu"), context_(nullptr), models_(models) {
+  // the models belong to this context, other threads have to bind it
+  aclError ret = aclrtGetCurrentContext(&context_);
+  if (ret != ACL_SUCCESS) {
+    ERROR_LOG("get current context failed, errorCode is %d", ret);
+  }
+}
+
+Result AclTarget::attachThread() {
+  aclError ret = aclrtSetCurrentContext(context_);
+  if (ret != ACL_SUCCESS) {
+    ERROR_LOG("set current context failed, errorCode is %d", ret);
+    return FAILED;
+  }
+  return SUCCESS;
+}
+
+void AclTarget::setModels(std::shared_ptr<NanoTrackModels> models) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  models_ = models;
+}
+
+Result AclTarget::runBackbone(BackboneModel model, const cv::Mat& crop,
+                              cv::Mat& feature) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Backbone& backbone =
+      (model == BACKBONE_T) ? models_->module_T127 : models_->module_X255;
+  cv::Mat img = crop;
+  void* host = backbone.runBackbone(img);
+  if (host == nullptr) {
+    return FAILED;
+  }
+  std::vector<int> dims;
+  Result ret = backbone.backbone_GetOutputDims(dims);
+  if (ret == SUCCESS) {
+    // host is reused by the next run, so the feature needs its own copy
+    feature = cv::Mat(dims, CV_32F, host).clone();
+  }
+  return ret;
+}
+
+Result AclTarget::runHead(const cv::Mat& feature_T, const cv::Mat& feature_X,
+                          std::vector<cv::Mat>& outputs) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Head& head = models_->module_head;
+  // head_Inference copies exactly inputSize() bytes from each pointer
+  const cv::Mat* features[2] = {&feature_T, &feature_X};
+  for (size_t i = 0; i < 2; ++i) {
+    const cv::Mat& feature = *features[i];
+    size_t bytes = feature.total() * feature.elemSize();
+    if (feature.empty() || !feature.isContinuous() ||
+        bytes != head.inputSize(i)) {
+      ERROR_LOG("head input %zu has %zu bytes, the model takes %zu", i,
+                feature.empty() ? 0 : bytes, head.inputSize(i));
+      return FAILED;
+    }
+  }
+  // head_Inference only reads the inputs
+  void* input_T = feature_T.data;
+  void* input_X = feature_X.data;
+  return head.runHead(outputs, input_T, input_X);
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "backbone.h"
+#include "head.h"
+#include "inference_target.h"
+
+// backT/backX/head loaded from one set of .om files. Trackers hold it
+// through a shared_ptr so a reload can swap in a new set while the old one
+// keeps serving; the last user frees it.
+struct NanoTrackModels {
+  NanoTrackModels(const std::string& Tback_model,
+                  const std::string& Xback_model,
+                  const std::string& Head_model);
+  Result initsource();
+  // work + weight device memory the set needs, without loading it
+  static Result querySize(const std::string& Tback_model,
+                          const std::string& Xback_model,
+                          const std::string& Head_model, size_t& device_bytes);
+
+  std::string T_path;
+  std::string X_path;
+  std::string head_path;
+  Backbone module_T127;
+  Backbone module_X255;
+  Head module_head;
+};
+
+// Runs a NanoTrackModels set on the ACL device.
+class AclTarget : public InferenceTarget {
+ public:
+  AclTarget(std::shared_ptr<NanoTrackModels> models);
+
+  void setModels(std::shared_ptr<NanoTrackModels> models);
+
+  const std::string& name() const override { return name_; }
+  // sets the context that was current when the target was created
+  Result attachThread() override;
+  Result runBackbone(BackboneModel model, const cv::Mat& crop,
+                     cv::Mat& feature) override;
+  Result runHead(const cv::Mat& feature_T, const cv::Mat& feature_X,
+                 std::vector<cv::Mat>& outputs) override;
+
+ private:
+  std::string name_;
+  aclrtContext context_;
+  // Backbone/Head reuse their device buffers across calls
+  std::mutex mutex_;
+  std::shared_ptr<NanoTrackModels> models_;
+};
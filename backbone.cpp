@@ -2,29 +2,60 @@
 
 #include <iostream>
 
-Backbone::Backbone(const char* modelPath) {
+// aclmdlDestroyDataset does not release the data buffers it holds
+void destroyDataset(aclmdlDataset* dataset) {
+  if (dataset == nullptr) {
+    return;
+  }
+  for (size_t i = 0; i < aclmdlGetDatasetNumBuffers(dataset); ++i) {
+    (void)aclDestroyDataBuffer(aclmdlGetDatasetBuffer(dataset, i));
+  }
+  (void)aclmdlDestroyDataset(dataset);
+}
+
+Backbone::Backbone(const char* modelPath, const char* tag)
+    : tag_(tag),
+      modelId_(0),
+      modelWorkSize_(0),
+      modelWeightSize_(0),
+      modelWorkPtr_(nullptr),
+      modelWeightPtr_(nullptr),
+      modelDesc_(nullptr),
+      modelLoaded_(false),
+      loaded_(false),
+      inputDataset_b(nullptr),
+      outputDataset_b(nullptr),
+      inputBuffer_b(nullptr),
+      outputBuffer_b(nullptr),
+      imageBytes(nullptr),
+      outputHost_b(nullptr) {
   aclError ret = aclmdlQuerySize(modelPath, &modelWorkSize_, &modelWeightSize_);
   if (ret != ACL_SUCCESS) {
     ERROR_LOG("query model failed, model file is %s, errorCode is %d",
               modelPath, static_cast<int32_t>(ret));
+    return;
   }
   // using ACL_MEM_MALLOC_HUGE_FIRST to malloc memory, huge memory is preferred
   // to use and huge memory can improve performance.
-  ret = aclrtMalloc(&modelWorkPtr_, modelWorkSize_, ACL_MEM_MALLOC_HUGE_FIRST);
+  MemAccount& mem = MemAccount::instance();
+  ret = mem.malloc(&modelWorkPtr_, modelWorkSize_, ACL_MEM_MALLOC_HUGE_FIRST,
+                   tag_ + "/work");
   if (ret != ACL_SUCCESS) {
     ERROR_LOG(
         "malloc buffer for work failed, require size is %zu, errorCode is %d",
         modelWorkSize_, static_cast<int32_t>(ret));
+    return;
   }
 
   // using ACL_MEM_MALLOC_HUGE_FIRST to malloc memory, huge memory is preferred
   // to use and huge memory can improve performance.
-  ret = aclrtMalloc(&modelWeightPtr_, modelWeightSize_,
-                    ACL_MEM_MALLOC_HUGE_FIRST);
+  ret = mem.malloc(&modelWeightPtr_, modelWeightSize_,
+                   ACL_MEM_MALLOC_HUGE_FIRST, tag_ + "/weight");
   if (ret != ACL_SUCCESS) {
     ERROR_LOG(
         "malloc buffer for weight failed, require size is %zu, errorCode is %d",
         modelWeightSize_, static_cast<int32_t>(ret));
+    return;
   }
 
   ret = aclmdlLoadFromFileWithMem(modelPath, &modelId_, modelWorkPtr_,
@@ -33,50 +64,81 @@ Backbone::Backbone(const char* modelPath) {
   if (ret != ACL_SUCCESS) {
     ERROR_LOG("load model from file failed, model file is %s, errorCode is %d",
               modelPath, static_cast<int32_t>(ret));
+    return;
   }
+  modelLoaded_ = true;
 
   modelDesc_ = aclmdlCreateDesc();
   if (modelDesc_ == nullptr) {
     ERROR_LOG("create model description failed");
+    return;
   }
 
   ret = aclmdlGetDesc(modelDesc_, modelId_);
   if (ret != ACL_SUCCESS) {
     ERROR_LOG("get model description failed, modelId is %u, errorCode is %d",
               modelId_, static_cast<int32_t>(ret));
+    return;
   }
+  loaded_ = true;
 }
 Backbone::~Backbone() {
   aclError ret;
+  MemAccount& mem = MemAccount::instance();
   // release resource includes acl resource, data set and unload model
-  aclrtFree(inputBuffer_b);
+  mem.free(inputBuffer_b);
   inputBuffer_b = nullptr;
-  (void)aclmdlDestroyDataset(inputDataset_b);
+  destroyDataset(inputDataset_b);
   inputDataset_b = nullptr;
 
-  aclrtFree(outputBuffer_b);
+  mem.free(outputBuffer_b);
   outputBuffer_b = nullptr;
-  (void)aclmdlDestroyDataset(outputDataset_b);
+  destroyDataset(outputDataset_b);
   outputDataset_b = nullptr;
 
-  ret = aclmdlDestroyDesc(modelDesc_);
-  if (ret != ACL_SUCCESS) {
-    ERROR_LOG("destroy description failed, errorCode is %d", ret);
+  mem.freeHost(imageBytes);
+  imageBytes = nullptr;
+  mem.freeHost(outputHost_b);
+  outputHost_b = nullptr;
+
+  if (modelDesc_ != nullptr) {
+    ret = aclmdlDestroyDesc(modelDesc_);
+    if (ret != ACL_SUCCESS) {
+      ERROR_LOG("destroy description failed, errorCode is %d", ret);
+    }
   }
 
-  ret = aclmdlUnload(modelId_);
-  if (ret != ACL_SUCCESS) {
-    ERROR_LOG("unload model failed, errorCode is %d", ret);
+  if (modelLoaded_) {
+    ret = aclmdlUnload(modelId_);
+    if (ret != ACL_SUCCESS) {
+      ERROR_LOG("unload model failed, errorCode is %d", ret);
+    }
   }
+  // the model memory outlives the model, so free it only after unloading
+  mem.free(modelWorkPtr_);
+  modelWorkPtr_ = nullptr;
+  mem.free(modelWeightPtr_);
+  modelWeightPtr_ = nullptr;
 }
 
 Result Backbone::backbone_initDatasets() {
   INFO_LOG("START backbone_initDatasets ");
+  if (!loaded_) {
+    ERROR_LOG("backbone_initDatasets: %s model not loaded", tag_.c_str());
+    return FAILED;
+  }
   aclError ret;
+  MemAccount& mem = MemAccount::instance();
   // create data set of input
   inputDataset_b = aclmdlCreateDataset();
   inputBufferSize_b = aclmdlGetInputSizeByIndex(modelDesc_, 0);
-  aclrtMalloc(&inputBuffer_b, inputBufferSize_b, ACL_MEM_MALLOC_HUGE_FIRST);
+  ret = mem.malloc(&inputBuffer_b, inputBufferSize_b, ACL_MEM_MALLOC_HUGE_FIRST,
+                   tag_ + "/input");
+  if (ret != ACL_SUCCESS) {
+    ERROR_LOG("malloc input buffer failed, require size is %zu, errorCode is %d",
+              inputBufferSize_b, ret);
+    return FAILED;
+  }
   aclDataBuffer* inputData =
       aclCreateDataBuffer(inputBuffer_b, inputBufferSize_b);
   ret = aclmdlAddDatasetBuffer(inputDataset_b, inputData);
@@ -91,7 +153,14 @@ Result Backbone::backbone_initDatasets() {
   // create data set of output
   outputDataset_b = aclmdlCreateDataset();
   modelOutputSize_b = aclmdlGetOutputSizeByIndex(modelDesc_, 0);
-  aclrtMalloc(&outputBuffer_b, modelOutputSize_b, ACL_MEM_MALLOC_HUGE_FIRST);
+  ret = mem.malloc(&outputBuffer_b, modelOutputSize_b,
+                   ACL_MEM_MALLOC_HUGE_FIRST, tag_ + "/output");
+  if (ret != ACL_SUCCESS) {
+    ERROR_LOG(
+        "malloc output buffer failed, require size is %zu, errorCode is %d",
+        modelOutputSize_b, ret);
+    return FAILED;
+  }
   aclDataBuffer* outputData =
       aclCreateDataBuffer(outputBuffer_b, modelOutputSize_b);
   ret = aclmdlAddDatasetBuffer(outputDataset_b, outputData);
@@ -102,35 +171,46 @@ Result Backbone::backbone_initDatasets() {
   } else {
     INFO_LOG("backbone_initDatasets outputDataset_b success");
   }
+
+  // host staging buffers are allocated once here instead of per frame
+  ret = mem.mallocHost(reinterpret_cast<void**>(&imageBytes), inputBufferSize_b,
+                       tag_ + "/host");
+  if (ret != ACL_SUCCESS) {
+    ERROR_LOG("malloc host input failed, require size is %zu, errorCode is %d",
+              inputBufferSize_b, ret);
+    return FAILED;
+  }
+  ret = mem.mallocHost(&outputHost_b, modelOutputSize_b, tag_ + "/host");
+  if (ret != ACL_SUCCESS) {
+    ERROR_LOG("malloc host output failed, require size is %zu, errorCode is %d",
+              modelOutputSize_b, ret);
+    return FAILED;
+  }
   INFO_LOG("FINISH backbone_initDatasets ");
   return SUCCESS;
 }
 
 Result Backbone::backbone_ProcessInput(cv::Mat& img) {
+  TRACE_SPAN("backbone_ProcessInput");
   INFO_LOG("START Preprocess the input img ");
 
   // get properties of image
   int32_t channel = img.channels();
   int32_t Height = img.rows;
   int32_t Weight = img.cols;
-  imageBytes = (float*)malloc(1 * channel * Height * Weight * sizeof(float));
-  memset(imageBytes, 0, 1 * channel * Height * Weight * sizeof(float));
-
-  // 图像转换为字节，从 HWC 到 NCHW
-  for (int h = 0; h < Height; ++h) {
-    for (int w = 0; w < Weight; ++w) {
-      for (int c = 0; c < channel; ++c) {
-        // 将像素值从 cv::Vec3b (即 uint8_t) 转换为 float
-        imageBytes[c * Height * Weight + h * Weight + w] =
-            static_cast<float>(img.at<cv::Vec3b>(h, w)[c]);
-      }
-    }
+  size_t bytes = 1 * channel * Height * Weight * sizeof(float);
+  if (imageBytes == nullptr || bytes != inputBufferSize_b) {
+    ERROR_LOG("input of %zu bytes does not match model input of %zu bytes",
+              bytes, inputBufferSize_b);
+    return FAILED;
   }
+  hwc_to_nchw(img, imageBytes);
   INFO_LOG("FINISH Preprocess the input img ");
   return SUCCESS;
 }
 
 Result Backbone::backbone_Inference() {
+  TRACE_SPAN("backbone_Inference");
   INFO_LOG("START ACNNModel_B::backbone_Inference");
   // copy host datainputs to device
   aclError ret = aclrtMemcpy(inputBuffer_b, inputBufferSize_b, this->imageBytes,
@@ -151,16 +231,18 @@ Result Backbone::backbone_Inference() {
 }
 
 void* Backbone::backbone_GetResults() {
+  TRACE_SPAN("backbone_GetResults");
   aclError ret;
-  void* outHostData = nullptr;
-  float* outData = nullptr;
   aclDataBuffer* dataBuffer = aclmdlGetDatasetBuffer(outputDataset_b, 0);
   void* data = aclGetDataBufferAddr(dataBuffer);
-  uint32_t output_length = aclGetDataBufferSizeV2(dataBuffer);
+  size_t output_length = aclGetDataBufferSizeV2(dataBuffer);
+  if (outputHost_b == nullptr || output_length > modelOutputSize_b) {
+    ERROR_LOG("host output buffer missing or too small");
+    return nullptr;
+  }
 
   // copy device output data to host
-  aclrtMallocHost(&outHostData, output_length);
-  ret = aclrtMemcpy(outHostData, output_length, data, output_length,
+  ret = aclrtMemcpy(outputHost_b, output_length, data, output_length,
                     ACL_MEMCPY_DEVICE_TO_HOST);
   if (ret != ACL_SUCCESS) {
     ERROR_LOG("memcpy  failed, errorCode is %d", ret);
@@ -168,10 +250,11 @@ void* Backbone::backbone_GetResults() {
   }
 
   INFO_LOG("FINISH ACNNModel_B::backbone_GetResults");
-  return outHostData;
+  return outputHost_b;
 }
 
 void* Backbone::runBackbone(cv::Mat& img) {
+  TRACE_SPAN("Backbone::runBackbone");
   //根据backbone与head的输入区别进行前处理
   Result ret;
   //前处理
@@ -187,10 +270,21 @@ void* Backbone::runBackbone(cv::Mat& img) {
     return nullptr;
   }
   //后处理
-  float* outData = backbone_GetResults();
-  if (ret != SUCCESS) {
-    ERROR_LOG("Inference  failed");
+  void* outData = backbone_GetResults();
+  if (outData == nullptr) {
+    ERROR_LOG("GetResults  failed");
     return nullptr;
   }
   return outData;
 }
+
+Result Backbone::backbone_GetOutputDims(std::vector<int>& dims) {
+  aclmdlIODims ioDims;
+  aclError ret = aclmdlGetOutputDims(modelDesc_, 0, &ioDims);
+  if (ret != ACL_SUCCESS) {
+    ERROR_LOG("aclmdlGetOutputDims failed, errorCode = %d", ret);
+    return FAILED;
+  }
+  dims.assign(ioDims.dims, ioDims.dims + ioDims.dimCount);
+  return SUCCESS;
+}
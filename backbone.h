@@ -4,32 +4,41 @@
 #include <opencv2/imgproc/imgproc.hpp>
 
 #include "acl.h"
+#include "common.h"
+#include "mem_account.h"
+#include "trace.h"
+#include "track_kernels.h"
 
-#define INFO_LOG(fmt, ...)                             \
-  fprintf(stdout, "[INFO]  " fmt "\n", ##__VA_ARGS__); \
-  fflush(stdout)
-#define ERROR_LOG(fmt, ...) fprintf(stderr, "[ERROR] " fmt "\n", ##__VA_ARGS__)
-
-typedef enum Result { SUCCESS = 0, FAILED = 1 } Result;
+// destroys a dataset together with the data buffers added to it
+void destroyDataset(aclmdlDataset* dataset);
 
 class Backbone {
  public:
-  Backbone(const char* modelPath);
+  // tag prefixes the memory accounting tags of every buffer this model owns
+  Backbone(const char* modelPath, const char* tag = "backbone");
   ~Backbone();
+  // the model file was loaded and described; false after any failure in the
+  // constructor, in which case initDatasets fails as well
+  bool loaded() const { return loaded_; }
   Result backbone_initDatasets();
   Result backbone_ProcessInput(cv::Mat& img);
   Result backbone_Inference();
   Result backbone_GetResults(std::vector<std::vector<float>>& output);
+  // returns a host buffer owned by the Backbone, overwritten by the next call
   void* backbone_GetResults();
   void* runBackbone(cv::Mat& img);
+  Result backbone_GetOutputDims(std::vector<int>& dims);
 
  private:
+  std::string tag_;
   uint32_t modelId_;
   size_t modelWorkSize_;    // model work memory buffer size
   size_t modelWeightSize_;  // model weight memory buffer size
   void* modelWorkPtr_;      // model work memory buffer
   void* modelWeightPtr_;    // model weight memory buffer
   aclmdlDesc* modelDesc_;
+  bool modelLoaded_;  // modelId_ needs unloading
+  bool loaded_;
 
   aclmdlDataset* inputDataset_b;
   aclmdlDataset* outputDataset_b;
@@ -37,5 +46,6 @@ class Backbone {
   void* outputBuffer_b;
   size_t inputBufferSize_b;
   size_t modelOutputSize_b;
-  float* imageBytes;
-};
\ No newline at end of file
+  float* imageBytes;     // host staging of the NCHW input, reused per frame
+  void* outputHost_b;    // host copy of the output, reused per frame
+};
@@ -0,0 +1,98 @@
+// Exercises InferenceDispatcher without an NPU: two CpuTargets on the ONNX
+// models in weights/, where the preferred one ("accel") is slowed down by
+// --slow-ms during the middle third of the run to mimic an accelerator
+// saturated by other workloads. Prints per-phase frame latency and the
+// dispatch metrics.
+//
+//   dispatch_bench [--weights ../weights] [--frames 300] [--slow-ms 60]
+//                  [--frame-budget-ms 23] [--budget-x-ms 15]
+//                  [--budget-head-ms 8]
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "cpu_target.h"
+#include "dispatcher.h"
+#include "trace.h"
+#include "track_kernels.h"
+
+static void printPhase(const char* name, std::vector<double> ms) {
+  if (ms.empty()) return;
+  std::sort(ms.begin(), ms.end());
+  printf("%-10s frames %4zu  p50 %7.2f ms  p99 %7.2f ms  max %7.2f ms\n", name,
+         ms.size(), ms[ms.size() / 2], ms[ms.size() * 99 / 100], ms.back());
+}
+
+int main(int argc, char* argv[]) {
+  std::string weights = "../weights";
+  int frames = 300;
+  double slow_ms = 60;
+  DispatchPolicy policy;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    std::string arg = argv[i];
+    if (arg == "--weights") {
+      weights = argv[i + 1];
+    } else if (arg == "--frames") {
+      frames = atoi(argv[i + 1]);
+    } else if (arg == "--slow-ms") {
+      slow_ms = atof(argv[i + 1]);
+    } else if (arg == "--frame-budget-ms") {
+      policy.setFrameBudget(atof(argv[i + 1]));
+    } else if (arg == "--budget-x-ms") {
+      policy.budget_ms[STAGE_BACKBONE_X] = atof(argv[i + 1]);
+    } else if (arg == "--budget-head-ms") {
+      policy.budget_ms[STAGE_HEAD] = atof(argv[i + 1]);
+    } else {
+      fprintf(stderr, "unknown option %s\n", argv[i]);
+      return 2;
+    }
+  }
+
+  std::string T = weights + "/nanotrack_backbone127.onnx";
+  std::string X = weights + "/nanotrack_backbone255.onnx";
+  std::string head = weights + "/nanotrack_head.onnx";
+  std::shared_ptr<CpuTarget> accel =
+      std::make_shared<CpuTarget>("accel", T, X, head);
+  std::shared_ptr<CpuTarget> cpu =
+      std::make_shared<CpuTarget>("cpu", T, X, head);
+  if (!accel->loaded() || !cpu->loaded()) {
+    fprintf(stderr, "models not found in %s\n", weights.c_str());
+    return 1;
+  }
+  InferenceDispatcher dispatcher(policy);
+  dispatcher.addTarget(accel);
+  dispatcher.addTarget(cpu);
+
+  cv::RNG rng(7);
+  cv::Mat z_crop(EXEMPLAR_SIZE, EXEMPLAR_SIZE, CV_8UC3);
+  cv::Mat x_crop(INSTANCE_SIZE, INSTANCE_SIZE, CV_8UC3);
+  rng.fill(z_crop, cv::RNG::UNIFORM, 0, 256);
+  rng.fill(x_crop, cv::RNG::UNIFORM, 0, 256);
+  cv::Mat feature_T, feature_X;
+  if (dispatcher.runBackbone(BACKBONE_T, z_crop, feature_T) != SUCCESS) {
+    return 1;
+  }
+
+  std::vector<double> phase_ms[3];
+  for (int f = 0; f < frames; ++f) {
+    int phase = f * 3 / frames;
+    accel->setDelayMs(phase == 1 ? slow_ms : 0);
+    std::vector<cv::Mat> outputs;
+    double start_ns = Trace::nowNs();
+    if (dispatcher.runBackbone(BACKBONE_X, x_crop, feature_X) != SUCCESS ||
+        dispatcher.runHead(feature_T, feature_X, outputs) != SUCCESS) {
+      return 1;
+    }
+    phase_ms[phase].push_back((Trace::nowNs() - start_ns) / 1e6);
+  }
+  printPhase("normal", phase_ms[0]);
+  printPhase("overload", phase_ms[1]);
+  printPhase("recovered", phase_ms[2]);
+  dispatcher.printMetrics();
+  return 0;
+}
@@ -0,0 +1,295 @@
+// Microbenchmarks for the CPU stages in track_kernels.h, driven with synthetic
+// frames and head outputs of the real shapes. Needs neither models nor an NPU.
+//
+//   kernel_bench [--filter <substring>] [--min-time-ms <ms>]
+//                [--baseline <file>] [--threshold <ratio>]
+//                [--save-baseline <file>]
+//
+// With --baseline the run exits with 1 when a case is slower than
+// baseline * (1 + threshold) or allocates more per call than the baseline.
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "track_kernels.h"
+
+// ---------------------------------------------------------------------------
+// allocation counting: interpose the glibc allocator, OpenCV's fastMalloc
+// ends up in posix_memalign and operator new in malloc
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t n, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+void* __libc_memalign(size_t alignment, size_t size);
+void __libc_free(void* ptr);
+}
+
+static bool g_count_allocs = false;
+static size_t g_allocs = 0;
+
+extern "C" void* malloc(size_t size) noexcept {
+  if (g_count_allocs) ++g_allocs;
+  return __libc_malloc(size);
+}
+extern "C" void* calloc(size_t n, size_t size) noexcept {
+  if (g_count_allocs) ++g_allocs;
+  return __libc_calloc(n, size);
+}
+extern "C" void* realloc(void* ptr, size_t size) noexcept {
+  if (g_count_allocs) ++g_allocs;
+  return __libc_realloc(ptr, size);
+}
+extern "C" void free(void* ptr) noexcept { __libc_free(ptr); }
+extern "C" void* memalign(size_t alignment, size_t size) noexcept {
+  if (g_count_allocs) ++g_allocs;
+  return __libc_memalign(alignment, size);
+}
+extern "C" void* aligned_alloc(size_t alignment, size_t size) noexcept {
+  if (g_count_allocs) ++g_allocs;
+  return __libc_memalign(alignment, size);
+}
+extern "C" int posix_memalign(void** ptr, size_t alignment,
+                              size_t size) noexcept {
+  if (g_count_allocs) ++g_allocs;
+  *ptr = __libc_memalign(alignment, size);
+  return *ptr == nullptr ? ENOMEM : 0;
+}
+
+// ---------------------------------------------------------------------------
+struct BenchCase {
+  std::string name;
+  std::function<void()> fn;
+};
+
+struct BenchResult {
+  double ns_per_call;
+  double allocs_per_call;
+};
+
+// same shapes as NanoTrack: 255/127 crops, 16x16 score map, stride 16
+static const int SCORE_SIZE = 16;
+static const int CLS_OUT_CHANNELS = 2;
+static const float PENALTY_K = 0.15f;
+static const float WINDOW_INFLUENCE = 0.455f;
+
+// results land here so the calls cannot be optimised away
+static cv::Mat g_sink_mat;
+static std::vector<float> g_sink_vec;
+static volatile float g_sink_f;
+
+static double nowNs() {
+  return std::chrono::duration<double, std::nano>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+static BenchResult runCase(const BenchCase& c, double min_time_ms) {
+  c.fn();  // warm caches and lazy OpenCV state
+  // grow the batch until one batch takes min_time_ms
+  long iters = 1;
+  for (;;) {
+    double t0 = nowNs();
+    for (long i = 0; i < iters; ++i) c.fn();
+    double elapsed = nowNs() - t0;
+    if (elapsed >= min_time_ms * 1e6 || iters >= (1L << 30)) break;
+    iters *= 2;
+  }
+  // best of three batches, counting allocations in each
+  BenchResult best = {1e300, 0};
+  for (int rep = 0; rep < 3; ++rep) {
+    g_allocs = 0;
+    g_count_allocs = true;
+    double t0 = nowNs();
+    for (long i = 0; i < iters; ++i) c.fn();
+    double elapsed = nowNs() - t0;
+    g_count_allocs = false;
+    if (elapsed / iters < best.ns_per_call) {
+      best.ns_per_call = elapsed / iters;
+    }
+    best.allocs_per_call = (double)g_allocs / iters;
+  }
+  return best;
+}
+
+static bool loadBaseline(const std::string& path,
+                         std::map<std::string, BenchResult>& baseline) {
+  std::ifstream in(path);
+  if (!in.good()) {
+    fprintf(stderr, "[ERROR] open baseline failed, file is %s\n",
+            path.c_str());
+    return false;
+  }
+  std::string line;
+  while (std::getline(in, line)) {
+    if (line.empty() || line[0] == '#') continue;
+    std::istringstream ss(line);
+    std::string name;
+    BenchResult r;
+    if (ss >> name >> r.ns_per_call >> r.allocs_per_call) {
+      baseline[name] = r;
+    }
+  }
+  return true;
+}
+
+static std::vector<BenchCase> makeCases() {
+  static cv::Mat frame_1080p(1080, 1920, CV_8UC3);
+  static cv::Mat frame_4k(2160, 3840, CV_8UC3);
+  static cv::Mat crop_x(INSTANCE_SIZE, INSTANCE_SIZE, CV_8UC3);
+  static cv::Mat crop_z(EXEMPLAR_SIZE, EXEMPLAR_SIZE, CV_8UC3);
+  static std::vector<float> nchw(3 * INSTANCE_SIZE * INSTANCE_SIZE);
+  static cv::Mat cls, loc, points, pred_bbox;
+  static std::vector<float> window, score, penalty;
+  static cv::Scalar avg;
+
+  cv::RNG rng(12345);
+  rng.fill(frame_1080p, cv::RNG::UNIFORM, 0, 256);
+  rng.fill(frame_4k, cv::RNG::UNIFORM, 0, 256);
+  rng.fill(crop_x, cv::RNG::UNIFORM, 0, 256);
+  rng.fill(crop_z, cv::RNG::UNIFORM, 0, 256);
+  avg = cv::mean(frame_1080p);
+
+  int cls_shape[] = {1, CLS_OUT_CHANNELS, SCORE_SIZE, SCORE_SIZE};
+  int loc_shape[] = {1, 4, SCORE_SIZE, SCORE_SIZE};
+  cls.create(4, cls_shape, CV_32F);
+  loc.create(4, loc_shape, CV_32F);
+  rng.fill(cls, cv::RNG::NORMAL, 0, 2);
+  // ltrb distances of a plausible box around each anchor point
+  rng.fill(loc, cv::RNG::UNIFORM, 8, 64);
+  points = generate_points(16, SCORE_SIZE);
+  window = create_hanning_window(SCORE_SIZE);
+  score = convert_score(cls, CLS_OUT_CHANNELS);
+  pred_bbox = convert_bbox(loc, points);
+
+  // a 137x226 target: s_z ~ 251, s_x ~ 504 (search), both shrink to the
+  // model input; border crops need padding on two sides
+  static const int s_x = 504, s_z = 251;
+  std::vector<BenchCase> cases;
+  cases.push_back({"get_subwindow/1080p/interior/search", [&] {
+    g_sink_mat = get_subwindow(frame_1080p, cv::Point2f(960, 540),
+                               INSTANCE_SIZE, s_x, avg);
+  }});
+  cases.push_back({"get_subwindow/1080p/border/search", [&] {
+    g_sink_mat = get_subwindow(frame_1080p, cv::Point2f(60, 1040),
+                               INSTANCE_SIZE, s_x, avg);
+  }});
+  cases.push_back({"get_subwindow/4k/interior/search", [&] {
+    g_sink_mat = get_subwindow(frame_4k, cv::Point2f(1920, 1080),
+                               INSTANCE_SIZE, s_x, avg);
+  }});
+  cases.push_back({"get_subwindow/4k/border/search", [&] {
+    g_sink_mat = get_subwindow(frame_4k, cv::Point2f(3800, 40),
+                               INSTANCE_SIZE, s_x, avg);
+  }});
+  cases.push_back({"get_subwindow/1080p/interior/template", [&] {
+    g_sink_mat = get_subwindow(frame_1080p, cv::Point2f(960, 540),
+                               EXEMPLAR_SIZE, s_z, avg);
+  }});
+  cases.push_back({"hwc_to_nchw/search", [&] {
+    hwc_to_nchw(crop_x, nchw.data());
+  }});
+  cases.push_back({"hwc_to_nchw/template", [&] {
+    hwc_to_nchw(crop_z, nchw.data());
+  }});
+  cases.push_back({"convert_score/16x16", [&] {
+    g_sink_vec = convert_score(cls, CLS_OUT_CHANNELS);
+  }});
+  cases.push_back({"convert_bbox/16x16", [&] {
+    g_sink_mat = convert_bbox(loc, points);
+  }});
+  cases.push_back({"apply_penalty/16x16", [&] {
+    g_sink_f = (float)apply_penalty(pred_bbox, score, window,
+                                    cv::Size2f(137, 226), 127.0f / s_z,
+                                    PENALTY_K, WINDOW_INFLUENCE, penalty);
+  }});
+  cases.push_back({"bbox_clip", [&] {
+    float cx, cy, w, h;
+    std::tie(cx, cy, w, h) =
+        bbox_clip(g_sink_f + 1950.0f, 540.0f, 137.0f, 5.0f,
+                  cv::Size(1920, 1080));
+    g_sink_f = cx + cy + w + h;
+  }});
+  return cases;
+}
+
+int main(int argc, char* argv[]) {
+  std::string filter, baseline_path, save_path;
+  double min_time_ms = 200.0;
+  double threshold = 0.10;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (i + 1 < argc && arg == "--filter") {
+      filter = argv[++i];
+    } else if (i + 1 < argc && arg == "--min-time-ms") {
+      min_time_ms = atof(argv[++i]);
+    } else if (i + 1 < argc && arg == "--baseline") {
+      baseline_path = argv[++i];
+    } else if (i + 1 < argc && arg == "--threshold") {
+      threshold = atof(argv[++i]);
+    } else if (i + 1 < argc && arg == "--save-baseline") {
+      save_path = argv[++i];
+    } else {
+      fprintf(stderr,
+              "usage: %s [--filter s] [--min-time-ms ms] [--baseline file]"
+              " [--threshold ratio] [--save-baseline file]\n",
+              argv[0]);
+      return 2;
+    }
+  }
+
+  std::map<std::string, BenchResult> baseline;
+  if (!baseline_path.empty() && !loadBaseline(baseline_path, baseline)) {
+    return 2;
+  }
+  cv::setNumThreads(1);  // per-call cost, not OpenCV's thread pool
+
+  std::vector<BenchCase> cases = makeCases();
+  std::ofstream save;
+  if (!save_path.empty()) {
+    save.open(save_path);
+    save << "# name ns_per_call allocs_per_call\n";
+  }
+  printf("%-40s %14s %12s %10s\n", "case", "ns/call", "allocs/call",
+         "vs base");
+  int regressions = 0;
+  for (size_t i = 0; i < cases.size(); ++i) {
+    if (!filter.empty() && cases[i].name.find(filter) == std::string::npos) {
+      continue;
+    }
+    BenchResult r = runCase(cases[i], min_time_ms);
+    char delta[32] = "";
+    std::map<std::string, BenchResult>::const_iterator base =
+        baseline.find(cases[i].name);
+    bool regressed = false;
+    if (base != baseline.end()) {
+      double ratio = r.ns_per_call / base->second.ns_per_call - 1.0;
+      snprintf(delta, sizeof(delta), "%+.1f%%", ratio * 100.0);
+      regressed = ratio > threshold ||
+                  r.allocs_per_call > base->second.allocs_per_call + 0.5;
+    }
+    printf("%-40s %14.1f %12.2f %10s%s\n", cases[i].name.c_str(),
+           r.ns_per_call, r.allocs_per_call, delta,
+           regressed ? "  REGRESSION" : "");
+    if (regressed) ++regressions;
+    if (save.is_open()) {
+      save << cases[i].name << " " << r.ns_per_call << " "
+           << r.allocs_per_call << "\n";
+    }
+  }
+  if (regressions > 0) {
+    printf("%d case(s) regressed beyond %.0f%%\n", regressions,
+           threshold * 100.0);
+    return 1;
+  }
+  return 0;
+}
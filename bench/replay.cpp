@@ -0,0 +1,188 @@
+// Replays a capture written with NANOTRACK_RECORD=<path> (tensor_record.h)
+// without models or an NPU: every tracked frame is cropped again from the
+// recorded patch, converted to NCHW, and postprocessed from the recorded head
+// outputs starting at the recorded tracker state. The crop must match the
+// recorded one bit for bit; the box and score must match exactly or within
+// the tolerances. Prints per-stage timing.
+//
+//   replay <capture> [--repeat 1] [--tolerance-px 0] [--tolerance-score 0]
+//
+// Exits with 1 on a mismatch. Replaying a board capture on x86 can differ in
+// the last bits (FMA contraction on aarch64), use small tolerances there.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "nanotrack.h"
+#include "tensor_record.h"
+#include "trace.h"
+#include "track_kernels.h"
+
+enum Stage { STAGE_CROP = 0, STAGE_NCHW, STAGE_POSTPROCESS, REPLAY_STAGES };
+static const char* STAGE_NAMES[REPLAY_STAGES] = {"crop", "nchw",
+                                                 "postprocess"};
+
+static void printStage(const char* name, std::vector<double> us) {
+  if (us.empty()) return;
+  std::sort(us.begin(), us.end());
+  double sum = 0;
+  for (size_t i = 0; i < us.size(); ++i) sum += us[i];
+  printf("%-12s runs %6zu  mean %8.1f us  p50 %8.1f us  p99 %8.1f us  "
+         "max %8.1f us\n",
+         name, us.size(), sum / us.size(), us[us.size() / 2],
+         us[us.size() * 99 / 100], us.back());
+}
+
+static bool sameBytes(const cv::Mat& a, const cv::Mat& b) {
+  if (a.rows != b.rows || a.cols != b.cols || a.type() != b.type()) {
+    return false;
+  }
+  size_t row_bytes = a.cols * a.elemSize();
+  for (int r = 0; r < a.rows; ++r) {
+    if (memcmp(a.ptr(r), b.ptr(r), row_bytes) != 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+int main(int argc, char* argv[]) {
+  if (argc < 2) {
+    fprintf(stderr,
+            "usage: replay <capture> [--repeat n] [--tolerance-px px] "
+            "[--tolerance-score s]\n");
+    return 2;
+  }
+  std::string path = argv[1];
+  int repeat = 1;
+  double tolerance_px = 0;
+  double tolerance_score = 0;
+  for (int i = 2; i + 1 < argc; i += 2) {
+    std::string arg = argv[i];
+    if (arg == "--repeat") {
+      repeat = std::max(1, atoi(argv[i + 1]));
+    } else if (arg == "--tolerance-px") {
+      tolerance_px = atof(argv[i + 1]);
+    } else if (arg == "--tolerance-score") {
+      tolerance_score = atof(argv[i + 1]);
+    } else {
+      fprintf(stderr, "unknown option %s\n", argv[i]);
+      return 2;
+    }
+  }
+
+  TensorRecordReader reader;
+  if (reader.open(path) != SUCCESS) {
+    return 1;
+  }
+  // no targets: the tracker is only used for its postprocessing
+  NanoTrack tracker(std::make_shared<InferenceDispatcher>());
+  std::vector<float> blob(3 * INSTANCE_SIZE * INSTANCE_SIZE);
+
+  std::vector<double> stage_us[REPLAY_STAGES];
+  size_t inits = 0, frames = 0, exact = 0, close = 0, mismatched = 0;
+  size_t crops_checked = 0, crops_mismatched = 0, incomplete = 0;
+  for (int pass = 0; pass < repeat; ++pass) {
+    for (size_t i = 0; i < reader.size(); ++i) {
+      const RecordHeader& record = reader.header(i);
+      if (record.kind == RECORD_INIT) {
+        inits += pass == 0;
+        continue;
+      }
+      if (record.kind != RECORD_TRACK) {
+        continue;
+      }
+      std::vector<cv::Mat> outputs;
+      outputs.push_back(reader.tensor(i, "score"));
+      outputs.push_back(reader.tensor(i, "delta"));
+      cv::Mat patch = reader.tensor(i, "patch");
+      if (outputs[0].empty() || outputs[1].empty()) {
+        incomplete += pass == 0;
+        continue;
+      }
+      if (patch.empty()) {
+        // the window was entirely outside the frame
+        patch = cv::Mat(0, 0, CV_8UC3);
+      }
+      cv::Scalar average(record.channel_average[0], record.channel_average[1],
+                         record.channel_average[2], record.channel_average[3]);
+      cv::Point2f pos(record.region_x - record.patch_x,
+                      record.region_y - record.patch_y);
+
+      int64_t t0 = Trace::nowNs();
+      cv::Mat crop = get_subwindow(patch, pos, INSTANCE_SIZE,
+                                   record.region_size, average);
+      int64_t t1 = Trace::nowNs();
+      hwc_to_nchw(crop, blob.data());
+      int64_t t2 = Trace::nowNs();
+      TrackState state = {cv::Point2f(record.center_x, record.center_y),
+                          cv::Size2f(record.width, record.height),
+                          record.frame_id};
+      tracker.setState(state);
+      cv::Rect bbox;
+      float score;
+      tracker.update(outputs,
+                     cv::Size(record.frame_width, record.frame_height), bbox,
+                     score);
+      int64_t t3 = Trace::nowNs();
+      stage_us[STAGE_CROP].push_back((t1 - t0) / 1e3);
+      stage_us[STAGE_NCHW].push_back((t2 - t1) / 1e3);
+      stage_us[STAGE_POSTPROCESS].push_back((t3 - t2) / 1e3);
+      if (pass > 0) {
+        continue;
+      }
+
+      frames++;
+      cv::Mat recorded_crop = reader.tensor(i, "crop");
+      if (!recorded_crop.empty()) {
+        crops_checked++;
+        if (!sameBytes(crop, recorded_crop)) {
+          crops_mismatched++;
+          printf("frame %lld target %d: crop differs\n",
+                 static_cast<long long>(record.frame_id), record.target_id);
+        }
+      }
+      cv::Rect recorded(record.bbox[0], record.bbox[1], record.bbox[2],
+                        record.bbox[3]);
+      double box_diff =
+          std::max(std::max(std::abs(bbox.x - recorded.x),
+                            std::abs(bbox.y - recorded.y)),
+                   std::max(std::abs(bbox.width - recorded.width),
+                            std::abs(bbox.height - recorded.height)));
+      double score_diff = fabs(score - record.score);
+      if (bbox == recorded && memcmp(&score, &record.score, sizeof(float)) == 0) {
+        exact++;
+      } else if (box_diff <= tolerance_px && score_diff <= tolerance_score) {
+        close++;
+      } else {
+        mismatched++;
+        printf("frame %lld target %d: box %d,%d %dx%d score %.6f, recorded "
+               "%d,%d %dx%d score %.6f\n",
+               static_cast<long long>(record.frame_id), record.target_id,
+               bbox.x, bbox.y, bbox.width, bbox.height, score, recorded.x,
+               recorded.y, recorded.width, recorded.height, record.score);
+      }
+    }
+  }
+
+  printf("%s: %zu records, %zu inits, %zu frames replayed x%d\n", path.c_str(),
+         reader.size(), inits, frames, repeat);
+  printf("results: %zu exact, %zu within tolerance, %zu mismatched", exact,
+         close, mismatched);
+  if (incomplete > 0) {
+    printf(", %zu without head outputs", incomplete);
+  }
+  printf("\ncrops: %zu checked, %zu differ\n", crops_checked,
+         crops_mismatched);
+  for (int s = 0; s < REPLAY_STAGES; ++s) {
+    printStage(STAGE_NAMES[s], stage_us[s]);
+  }
+  return (mismatched > 0 || crops_mismatched > 0) ? 1 : 0;
+}
@@ -0,0 +1,9 @@
+#pragma once
+#include <stdio.h>
+
+#define INFO_LOG(fmt, ...)                             \
+  fprintf(stdout, "[INFO]  " fmt "\n", ##__VA_ARGS__); \
+  fflush(stdout)
+#define ERROR_LOG(fmt, ...) fprintf(stderr, "[ERROR] " fmt "\n", ##__VA_ARGS__)
+
+typedef enum Result { SUCCESS = 0, FAILED = 1 } Result;
@@ -0,0 +1,230 @@
+#include "cpu_target.h"
+
+#include <string.h>
+#include <unistd.h>
+
+#include "onnx_info.h"
+#include "trace.h"
+
+// items: 1xCxHxW blobs of one shape -> NxCxHxW
+static cv::Mat stackBlobs(const std::vector<cv::Mat>& items) {
+  std::vector<int> shape(items[0].size.p, items[0].size.p + items[0].dims);
+  shape[0] = static_cast<int>(items.size());
+  cv::Mat blob(shape, CV_32F);
+  size_t bytes = items[0].total() * items[0].elemSize();
+  for (size_t i = 0; i < items.size(); ++i) {
+    memcpy(blob.ptr<float>(static_cast<int>(i)), items[i].ptr<float>(), bytes);
+  }
+  return blob;
+}
+
+// NxCxHxW -> N blobs of 1xCxHxW, false if the batch dimension is not n
+static bool splitBlob(const cv::Mat& blob, size_t n,
+                      std::vector<cv::Mat>& items) {
+  if (blob.dims < 2 || blob.size[0] != static_cast<int>(n)) {
+    return false;
+  }
+  std::vector<int> shape(blob.size.p, blob.size.p + blob.dims);
+  shape[0] = 1;
+  items.resize(n);
+  for (size_t i = 0; i < n; ++i) {
+    // blob is the net's own buffer, the items need their own copy
+    items[i] = cv::Mat(shape, CV_32F,
+                       const_cast<float*>(blob.ptr<float>(static_cast<int>(i))))
+                   .clone();
+  }
+  return true;
+}
+
+static cv::dnn::Net loadNet(const std::string& path) {
+  cv::dnn::Net net;
+  try {
+    net = cv::dnn::readNetFromONNX(path);
+  } catch (const cv::Exception& e) {
+    ERROR_LOG("load onnx model failed, model file is %s: %s", path.c_str(),
+              e.what());
+    return net;
+  }
+  net.setPreferableBackend(cv::dnn::DNN_BACKEND_OPENCV);
+  net.setPreferableTarget(cv::dnn::DNN_TARGET_CPU);
+  return net;
+}
+
+// OpenCV does not reliably reject an N-batch blob on a model exported with a
+// fixed batch of 1: the backbones die with SIGFPE in shape inference instead
+// of throwing. So only batch models whose inputs leave the batch open.
+static bool batchDynamic(const std::string& path) {
+  std::vector<OnnxTensorInfo> inputs, outputs;
+  if (!readOnnxInfo(path, inputs, outputs)) {
+    return false;
+  }
+  for (size_t i = 0; i < inputs.size(); ++i) {
+    if (inputs[i].symbolic.empty() || !inputs[i].symbolic[0]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+CpuTarget::CpuTarget(const std::string& name, const std::string& T_model_path,
+                     const std::string& X_model_path,
+                     const std::string& head_model_path, double delay_ms)
+    : name_(name),
+      net_T_(loadNet(T_model_path)),
+      net_X_(loadNet(X_model_path)),
+      net_head_(loadNet(head_model_path)),
+      delay_ms_(delay_ms) {
+  batch_ok_[0] = batchDynamic(T_model_path) && batchDynamic(X_model_path);
+  batch_ok_[1] = batchDynamic(head_model_path);
+}
+
+bool CpuTarget::loaded() const {
+  return !net_T_.empty() && !net_X_.empty() && !net_head_.empty();
+}
+
+void CpuTarget::setDelayMs(double delay_ms) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  delay_ms_ = delay_ms;
+}
+
+void CpuTarget::delay(double start_ns) {
+  double left_ms = delay_ms_ - (Trace::nowNs() - start_ns) / 1e6;
+  if (left_ms > 0) {
+    usleep(static_cast<useconds_t>(left_ms * 1000));
+  }
+}
+
+Result CpuTarget::runBackbone(BackboneModel model, const cv::Mat& crop,
+                              cv::Mat& feature) {
+  TRACE_SPAN("CpuTarget::runBackbone");
+  std::lock_guard<std::mutex> lock(mutex_);
+  double start_ns = Trace::nowNs();
+  cv::dnn::Net& net = (model == BACKBONE_T) ? net_T_ : net_X_;
+  if (net.empty()) {
+    return FAILED;
+  }
+  try {
+    // raw 0..255 BGR in NCHW, same as Backbone::backbone_ProcessInput
+    net.setInput(cv::dnn::blobFromImage(crop), "input");
+    // forward() may hand out the net's own buffer, which the next call reuses
+    feature = net.forward("output").clone();
+  } catch (const cv::Exception& e) {
+    ERROR_LOG("%s backbone forward failed: %s", name_.c_str(), e.what());
+    return FAILED;
+  }
+  delay(start_ns);
+  return SUCCESS;
+}
+
+Result CpuTarget::runHead(const cv::Mat& feature_T, const cv::Mat& feature_X,
+                          std::vector<cv::Mat>& outputs) {
+  TRACE_SPAN("CpuTarget::runHead");
+  std::lock_guard<std::mutex> lock(mutex_);
+  double start_ns = Trace::nowNs();
+  if (net_head_.empty()) {
+    return FAILED;
+  }
+  try {
+    net_head_.setInput(feature_T, "input1");
+    net_head_.setInput(feature_X, "input2");
+    std::vector<cv::Mat> outs;
+    net_head_.forward(outs, std::vector<cv::String>{"output1", "output2"});
+    outputs.resize(outs.size());
+    for (size_t i = 0; i < outs.size(); ++i) {
+      outputs[i] = outs[i].clone();
+    }
+  } catch (const cv::Exception& e) {
+    ERROR_LOG("%s head forward failed: %s", name_.c_str(), e.what());
+    return FAILED;
+  }
+  delay(start_ns);
+  return SUCCESS;
+}
+
+Result CpuTarget::forwardBackboneBatch(BackboneModel model,
+                                       const std::vector<cv::Mat>& crops,
+                                       std::vector<cv::Mat>& features) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  double start_ns = Trace::nowNs();
+  cv::dnn::Net& net = (model == BACKBONE_T) ? net_T_ : net_X_;
+  if (net.empty()) {
+    return FAILED;
+  }
+  try {
+    net.setInput(cv::dnn::blobFromImages(crops), "input");
+    if (!splitBlob(net.forward("output"), crops.size(), features)) {
+      ERROR_LOG("%s backbone has a fixed batch, batching disabled",
+                name_.c_str());
+      batch_ok_[0] = false;
+      return FAILED;
+    }
+  } catch (const cv::Exception& e) {
+    ERROR_LOG("%s batched backbone forward failed, batching disabled: %s",
+              name_.c_str(), e.what());
+    batch_ok_[0] = false;
+    return FAILED;
+  }
+  delay(start_ns);
+  return SUCCESS;
+}
+
+Result CpuTarget::runBackboneBatch(BackboneModel model,
+                                   const std::vector<cv::Mat>& crops,
+                                   std::vector<cv::Mat>& features) {
+  TRACE_SPAN("CpuTarget::runBackboneBatch");
+  if (crops.size() > 1 && batch_ok_[0] &&
+      forwardBackboneBatch(model, crops, features) == SUCCESS) {
+    return SUCCESS;
+  }
+  return InferenceTarget::runBackboneBatch(model, crops, features);
+}
+
+Result CpuTarget::forwardHeadBatch(const std::vector<cv::Mat>& features_T,
+                                   const std::vector<cv::Mat>& features_X,
+                                   std::vector<std::vector<cv::Mat>>& outputs) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  double start_ns = Trace::nowNs();
+  if (net_head_.empty()) {
+    return FAILED;
+  }
+  size_t n = features_X.size();
+  try {
+    net_head_.setInput(stackBlobs(features_T), "input1");
+    net_head_.setInput(stackBlobs(features_X), "input2");
+    std::vector<cv::Mat> outs;
+    net_head_.forward(outs, std::vector<cv::String>{"output1", "output2"});
+    std::vector<std::vector<cv::Mat>> per_output(outs.size());
+    for (size_t k = 0; k < outs.size(); ++k) {
+      if (!splitBlob(outs[k], n, per_output[k])) {
+        ERROR_LOG("%s head has a fixed batch, batching disabled",
+                  name_.c_str());
+        batch_ok_[1] = false;
+        return FAILED;
+      }
+    }
+    outputs.assign(n, std::vector<cv::Mat>(outs.size()));
+    for (size_t i = 0; i < n; ++i) {
+      for (size_t k = 0; k < outs.size(); ++k) {
+        outputs[i][k] = per_output[k][i];
+      }
+    }
+  } catch (const cv::Exception& e) {
+    ERROR_LOG("%s batched head forward failed, batching disabled: %s",
+              name_.c_str(), e.what());
+    batch_ok_[1] = false;
+    return FAILED;
+  }
+  delay(start_ns);
+  return SUCCESS;
+}
+
+Result CpuTarget::runHeadBatch(const std::vector<cv::Mat>& features_T,
+                               const std::vector<cv::Mat>& features_X,
+                               std::vector<std::vector<cv::Mat>>& outputs) {
+  TRACE_SPAN("CpuTarget::runHeadBatch");
+  if (features_X.size() > 1 && batch_ok_[1] &&
+      forwardHeadBatch(features_T, features_X, outputs) == SUCCESS) {
+    return SUCCESS;
+  }
+  return InferenceTarget::runHeadBatch(features_T, features_X, outputs);
+}
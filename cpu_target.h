@@ -0,0 +1,55 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <opencv2/dnn.hpp>
+
+#include "inference_target.h"
+
+// Runs the ONNX models from weights/ with OpenCV DNN on the CPU. Used as the
+// fallback when the accelerator is overloaded. delay_ms adds an artificial
+// latency to every execution, which lets two CpuTargets stand in for a slow
+// accelerator and its fallback on machines without an NPU.
+class CpuTarget : public InferenceTarget {
+ public:
+  CpuTarget(const std::string& name, const std::string& T_model_path,
+            const std::string& X_model_path,
+            const std::string& head_model_path, double delay_ms = 0);
+
+  // all three nets loaded
+  bool loaded() const;
+  void setDelayMs(double delay_ms);
+
+  const std::string& name() const override { return name_; }
+  Result runBackbone(BackboneModel model, const cv::Mat& crop,
+                     cv::Mat& feature) override;
+  Result runHead(const cv::Mat& feature_T, const cv::Mat& feature_X,
+                 std::vector<cv::Mat>& outputs) override;
+  // one forward over an N-batch blob if the models were exported with a
+  // dynamic batch, else single items; a failing batched forward also falls
+  // back to single items for good
+  Result runBackboneBatch(BackboneModel model,
+                          const std::vector<cv::Mat>& crops,
+                          std::vector<cv::Mat>& features) override;
+  Result runHeadBatch(const std::vector<cv::Mat>& features_T,
+                      const std::vector<cv::Mat>& features_X,
+                      std::vector<std::vector<cv::Mat>>& outputs) override;
+
+ private:
+  void delay(double start_ns);
+  Result forwardBackboneBatch(BackboneModel model,
+                              const std::vector<cv::Mat>& crops,
+                              std::vector<cv::Mat>& features);
+  Result forwardHeadBatch(const std::vector<cv::Mat>& features_T,
+                          const std::vector<cv::Mat>& features_X,
+                          std::vector<std::vector<cv::Mat>>& outputs);
+
+  std::string name_;
+  // cv::dnn::Net is not reentrant
+  std::mutex mutex_;
+  cv::dnn::Net net_T_;
+  cv::dnn::Net net_X_;
+  cv::dnn::Net net_head_;
+  double delay_ms_;
+  std::atomic<bool> batch_ok_[2];  // backbone, head
+};
@@ -0,0 +1,321 @@
+#include "dispatcher.h"
+
+#include <algorithm>
+
+#include "trace.h"
+
+static const char* STAGE_NAMES[STAGE_COUNT] = {"backT", "backX", "head"};
+
+// probes outlive the call that started them, so they own their inputs
+static std::function<Result(InferenceTarget&)> backboneProbe(
+    BackboneModel model, const cv::Mat& crop) {
+  cv::Mat input = crop.clone();
+  return [model, input](InferenceTarget& target) {
+    cv::Mat feature;
+    return target.runBackbone(model, input, feature);
+  };
+}
+
+static std::function<Result(InferenceTarget&)> headProbe(
+    const cv::Mat& feature_T, const cv::Mat& feature_X) {
+  cv::Mat input_T = feature_T.clone();
+  cv::Mat input_X = feature_X.clone();
+  return [input_T, input_X](InferenceTarget& target) {
+    std::vector<cv::Mat> outputs;
+    return target.runHead(input_T, input_X, outputs);
+  };
+}
+
+DispatchPolicy::DispatchPolicy() : ewma_alpha(0.2), probe_interval(30) {
+  // the template is encoded once per target, only search frames are tight
+  budget_ms[STAGE_BACKBONE_T] = 200.0;
+  setFrameBudget(23.0);
+}
+
+void DispatchPolicy::setFrameBudget(double frame_ms) {
+  budget_ms[STAGE_BACKBONE_X] = frame_ms * 15.0 / 23.0;
+  budget_ms[STAGE_HEAD] = frame_ms * 8.0 / 23.0;
+}
+
+struct InferenceDispatcher::TargetSlot {
+  std::shared_ptr<InferenceTarget> target;
+  int in_flight;
+  int skipped;
+  // a probe runs, its sample replaces the average; live executions keep off
+  // the target meanwhile, a target runs one model at a time
+  bool probing;
+  uint64_t executions[STAGE_COUNT];
+  uint64_t failures;
+  double ewma_ms[STAGE_COUNT];  // 0 until the first sample
+  double max_ms[STAGE_COUNT];
+};
+
+InferenceDispatcher::InferenceDispatcher(const DispatchPolicy& policy)
+    : policy_(policy), probes_(0), probe_running_(false) {
+  std::fill(fallbacks_, fallbacks_ + STAGE_COUNT, 0);
+}
+
+InferenceDispatcher::~InferenceDispatcher() {
+  if (probe_thread_.joinable()) {
+    probe_thread_.join();
+  }
+}
+
+void InferenceDispatcher::addTarget(std::shared_ptr<InferenceTarget> target) {
+  std::unique_ptr<TargetSlot> slot(new TargetSlot());
+  slot->target = target;
+  slot->in_flight = 0;
+  slot->skipped = 0;
+  slot->probing = false;
+  slot->failures = 0;
+  std::fill(slot->executions, slot->executions + STAGE_COUNT, 0);
+  std::fill(slot->ewma_ms, slot->ewma_ms + STAGE_COUNT, 0.0);
+  std::fill(slot->max_ms, slot->max_ms + STAGE_COUNT, 0.0);
+  std::lock_guard<std::mutex> lock(mutex_);
+  targets_.push_back(std::move(slot));
+}
+
+void InferenceDispatcher::setPolicy(const DispatchPolicy& policy) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  policy_ = policy;
+}
+
+size_t InferenceDispatcher::targetCount() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return targets_.size();
+}
+
+size_t InferenceDispatcher::choose(DispatchStage stage, size_t& probe) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  probe = targets_.size();
+  size_t chosen = targets_.size();
+  size_t fastest = targets_.size();
+  double fastest_ms = 0;
+  for (size_t i = 0; i < targets_.size(); ++i) {
+    TargetSlot& slot = *targets_[i];
+    if (slot.probing) {
+      continue;
+    }
+    double predicted_ms = slot.ewma_ms[stage] * (slot.in_flight + 1);
+    if (predicted_ms <= policy_.budget_ms[stage]) {
+      chosen = i;
+      break;
+    }
+    if (fastest == targets_.size() || predicted_ms < fastest_ms) {
+      fastest = i;
+      fastest_ms = predicted_ms;
+    }
+  }
+  if (chosen == targets_.size()) {
+    // a probe only starts beside a live execution, so fastest is set
+    chosen = fastest;
+  }
+  // preferred targets that were passed over: probe one that has been skipped
+  // long enough, its estimate may be stale. The execution itself still goes
+  // to the chosen target; sending it to one predicted to miss the budget
+  // would miss the deadline on purpose. Only an idle target is probed, so
+  // the probe neither waits for nor delays a live execution.
+  for (size_t i = 0; i < chosen; ++i) {
+    if (targets_[i]->probing) {
+      continue;
+    }
+    if (++targets_[i]->skipped >= policy_.probe_interval &&
+        !probe_running_ && targets_[i]->in_flight == 0) {
+      probe = i;
+      probe_running_ = true;
+      targets_[i]->skipped = 0;
+      targets_[i]->probing = true;
+      targets_[i]->in_flight++;
+      ++probes_;
+      break;
+    }
+  }
+  targets_[chosen]->skipped = 0;
+  targets_[chosen]->in_flight++;
+  if (chosen != 0) {
+    ++fallbacks_[stage];
+  }
+  return chosen;
+}
+
+void InferenceDispatcher::finish(size_t index, DispatchStage stage,
+                                 double start_ns, size_t items, bool ok) {
+  double ms = (Trace::nowNs() - start_ns) / 1e6 / items;
+  std::lock_guard<std::mutex> lock(mutex_);
+  TargetSlot& slot = *targets_[index];
+  slot.in_flight--;
+  if (!ok) {
+    // keep it out of the way until a probe shows it works again
+    slot.probing = false;
+    slot.failures++;
+    slot.ewma_ms[stage] =
+        std::max(slot.ewma_ms[stage], 2 * policy_.budget_ms[stage]);
+    return;
+  }
+  slot.executions[stage] += items;
+  double alpha =
+      (slot.ewma_ms[stage] == 0 || slot.probing) ? 1.0 : policy_.ewma_alpha;
+  slot.probing = false;
+  slot.ewma_ms[stage] = alpha * ms + (1 - alpha) * slot.ewma_ms[stage];
+  slot.max_ms[stage] = std::max(slot.max_ms[stage], ms);
+}
+
+void InferenceDispatcher::startProbe(size_t index, DispatchStage stage,
+                                     Probe probe) {
+  // the previous probe has cleared probe_running_, so it is about to exit
+  if (probe_thread_.joinable()) {
+    probe_thread_.join();
+  }
+  std::shared_ptr<InferenceTarget> target;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    target = targets_[index]->target;
+  }
+  probe_thread_ = std::thread([this, target, index, stage, probe]() {
+    TRACE_THREAD_NAME("dispatch_probe");
+    TRACE_SPAN("InferenceDispatcher::probe");
+    double start_ns = Trace::nowNs();
+    bool ok = target->attachThread() == SUCCESS && probe(*target) == SUCCESS;
+    finish(index, stage, start_ns, 1, ok);
+    std::lock_guard<std::mutex> lock(mutex_);
+    probe_running_ = false;
+  });
+}
+
+template <typename Run, typename MakeProbe>
+Result InferenceDispatcher::dispatch(DispatchStage stage, size_t items,
+                                     Run run, MakeProbe make_probe) {
+  if (targetCount() == 0) {
+    ERROR_LOG("no inference target");
+    return FAILED;
+  }
+  size_t probe;
+  size_t first = choose(stage, probe);
+  size_t count = targetCount();
+  if (probe < count) {
+    startProbe(probe, stage, make_probe());
+  }
+  // on failure try the remaining targets in preference order, except one
+  // that is being probed
+  for (size_t n = 0; n < count; ++n) {
+    size_t index = (n == 0) ? first : n - 1 + (n - 1 >= first);
+    std::shared_ptr<InferenceTarget> target;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (n > 0 && targets_[index]->probing) {
+        continue;
+      }
+      if (n > 0) {
+        targets_[index]->in_flight++;
+      }
+      target = targets_[index]->target;
+    }
+    double start_ns = Trace::nowNs();
+    Result ret = run(*target);
+    finish(index, stage, start_ns, items, ret == SUCCESS);
+    if (ret == SUCCESS) {
+      return SUCCESS;
+    }
+    ERROR_LOG("%s failed on %s", STAGE_NAMES[stage], target->name().c_str());
+  }
+  return FAILED;
+}
+
+Result InferenceDispatcher::runBackbone(BackboneModel model,
+                                        const cv::Mat& crop,
+                                        cv::Mat& feature) {
+  DispatchStage stage =
+      (model == BACKBONE_T) ? STAGE_BACKBONE_T : STAGE_BACKBONE_X;
+  return dispatch(
+      stage, 1,
+      [&](InferenceTarget& target) {
+        return target.runBackbone(model, crop, feature);
+      },
+      [&]() { return backboneProbe(model, crop); });
+}
+
+Result InferenceDispatcher::runHead(const cv::Mat& feature_T,
+                                    const cv::Mat& feature_X,
+                                    std::vector<cv::Mat>& outputs) {
+  return dispatch(
+      STAGE_HEAD, 1,
+      [&](InferenceTarget& target) {
+        return target.runHead(feature_T, feature_X, outputs);
+      },
+      [&]() { return headProbe(feature_T, feature_X); });
+}
+
+Result InferenceDispatcher::runBackboneBatch(BackboneModel model,
+                                             const std::vector<cv::Mat>& crops,
+                                             std::vector<cv::Mat>& features) {
+  if (crops.empty()) {
+    features.clear();
+    return SUCCESS;
+  }
+  DispatchStage stage =
+      (model == BACKBONE_T) ? STAGE_BACKBONE_T : STAGE_BACKBONE_X;
+  // the probe runs a single item, its latency is per item anyway
+  return dispatch(
+      stage, crops.size(),
+      [&](InferenceTarget& target) {
+        return target.runBackboneBatch(model, crops, features);
+      },
+      [&]() { return backboneProbe(model, crops[0]); });
+}
+
+Result InferenceDispatcher::runHeadBatch(
+    const std::vector<cv::Mat>& features_T,
+    const std::vector<cv::Mat>& features_X,
+    std::vector<std::vector<cv::Mat>>& outputs) {
+  if (features_X.empty()) {
+    outputs.clear();
+    return SUCCESS;
+  }
+  return dispatch(
+      STAGE_HEAD, features_X.size(),
+      [&](InferenceTarget& target) {
+        return target.runHeadBatch(features_T, features_X, outputs);
+      },
+      [&]() { return headProbe(features_T[0], features_X[0]); });
+}
+
+DispatchMetrics InferenceDispatcher::metrics() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  DispatchMetrics metrics;
+  for (size_t i = 0; i < targets_.size(); ++i) {
+    const TargetSlot& slot = *targets_[i];
+    DispatchTargetStats stats;
+    stats.name = slot.target->name();
+    stats.in_flight = slot.in_flight;
+    stats.failures = slot.failures;
+    for (int s = 0; s < STAGE_COUNT; ++s) {
+      stats.executions[s] = slot.executions[s];
+      stats.ewma_ms[s] = slot.ewma_ms[s];
+      stats.max_ms[s] = slot.max_ms[s];
+    }
+    metrics.targets.push_back(stats);
+  }
+  std::copy(fallbacks_, fallbacks_ + STAGE_COUNT, metrics.fallbacks);
+  metrics.probes = probes_;
+  return metrics;
+}
+
+void InferenceDispatcher::printMetrics() const {
+  DispatchMetrics m = metrics();
+  for (size_t i = 0; i < m.targets.size(); ++i) {
+    const DispatchTargetStats& t = m.targets[i];
+    for (int s = 0; s < STAGE_COUNT; ++s) {
+      INFO_LOG("dispatch %-8s %-5s runs %-8llu avg %7.2f ms max %7.2f ms",
+               t.name.c_str(), STAGE_NAMES[s],
+               static_cast<unsigned long long>(t.executions[s]), t.ewma_ms[s],
+               t.max_ms[s]);
+    }
+    INFO_LOG("dispatch %-8s failures %llu", t.name.c_str(),
+             static_cast<unsigned long long>(t.failures));
+  }
+  INFO_LOG("dispatch fallbacks backT %llu backX %llu head %llu, probes %llu",
+           static_cast<unsigned long long>(m.fallbacks[STAGE_BACKBONE_T]),
+           static_cast<unsigned long long>(m.fallbacks[STAGE_BACKBONE_X]),
+           static_cast<unsigned long long>(m.fallbacks[STAGE_HEAD]),
+           static_cast<unsigned long long>(m.probes));
+}
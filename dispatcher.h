@@ -0,0 +1,114 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "inference_target.h"
+
+enum DispatchStage {
+  STAGE_BACKBONE_T = 0,
+  STAGE_BACKBONE_X,
+  STAGE_HEAD,
+  STAGE_COUNT
+};
+
+struct DispatchPolicy {
+  DispatchPolicy();
+
+  // Derives the backX and head budgets from the inference budget of one
+  // search frame, which is exactly one backX followed by one head
+  // execution. The split follows their cost on the NPU (about 2:1); the
+  // default is 23 ms, leaving 10 ms of a 30 fps frame for decode, crop and
+  // postprocessing.
+  void setFrameBudget(double frame_ms);
+
+  // latency budget per execution; a target whose predicted latency exceeds
+  // it is skipped in favour of the next one
+  double budget_ms[STAGE_COUNT];
+  // weight of the newest sample in the per-target latency average
+  double ewma_alpha;
+  // after this many skips a target gets probed, so its estimate recovers
+  // once the overload is gone. The probe is a copy of the skipped execution
+  // run on a background thread when the target is idle; the frame itself
+  // never waits for it, live executions avoid the target until it is done.
+  int probe_interval;
+};
+
+struct DispatchTargetStats {
+  std::string name;
+  int in_flight;
+  uint64_t executions[STAGE_COUNT];
+  uint64_t failures;
+  double ewma_ms[STAGE_COUNT];
+  double max_ms[STAGE_COUNT];
+};
+
+struct DispatchMetrics {
+  std::vector<DispatchTargetStats> targets;
+  // executions that did not go to the first (preferred) target
+  uint64_t fallbacks[STAGE_COUNT];
+  uint64_t probes;
+};
+
+// Routes each backbone/head execution to one of several inference targets.
+// Targets are kept in preference order (the NPU first). For every target the
+// dispatcher tracks executions in flight and an average latency per stage;
+// the predicted latency is average * (in_flight + 1). An execution goes to
+// the first target predicted to finish within the stage budget, or to the
+// fastest predicted one if none is. A failing target falls through to the
+// next one.
+class InferenceDispatcher {
+ public:
+  explicit InferenceDispatcher(const DispatchPolicy& policy = DispatchPolicy());
+  ~InferenceDispatcher();
+
+  void addTarget(std::shared_ptr<InferenceTarget> target);
+  void setPolicy(const DispatchPolicy& policy);
+  size_t targetCount() const;
+
+  Result runBackbone(BackboneModel model, const cv::Mat& crop,
+                     cv::Mat& feature);
+  Result runHead(const cv::Mat& feature_T, const cv::Mat& feature_X,
+                 std::vector<cv::Mat>& outputs);
+  // A whole batch goes to one target; its latency is recorded per item, so
+  // the estimates stay comparable with single executions.
+  Result runBackboneBatch(BackboneModel model,
+                          const std::vector<cv::Mat>& crops,
+                          std::vector<cv::Mat>& features);
+  Result runHeadBatch(const std::vector<cv::Mat>& features_T,
+                      const std::vector<cv::Mat>& features_X,
+                      std::vector<std::vector<cv::Mat>>& outputs);
+
+  DispatchMetrics metrics() const;
+  void printMetrics() const;
+
+ private:
+  struct TargetSlot;
+
+  typedef std::function<Result(InferenceTarget&)> Probe;
+
+  // probe is set to a passed-over target that is due for a probe
+  size_t choose(DispatchStage stage, size_t& probe);
+  void finish(size_t index, DispatchStage stage, double start_ns,
+              size_t items, bool ok);
+  // make_probe returns a Probe that owns copies of the inputs
+  template <typename Run, typename MakeProbe>
+  Result dispatch(DispatchStage stage, size_t items, Run run,
+                  MakeProbe make_probe);
+  void startProbe(size_t index, DispatchStage stage, Probe probe);
+
+  DispatchPolicy policy_;
+  mutable std::mutex mutex_;
+  std::vector<std::unique_ptr<TargetSlot>> targets_;
+  uint64_t fallbacks_[STAGE_COUNT];
+  uint64_t probes_;
+  // at most one probe runs at a time
+  bool probe_running_;
+  std::thread probe_thread_;
+};
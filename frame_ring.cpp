@@ -0,0 +1,315 @@
+#include "frame_ring.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <new>
+
+static const uint32_t FRAME_RING_MAGIC = 0x4e54524eu;  // "NTRN"
+static const uint32_t FRAME_RING_VERSION = 1;
+// bumped whenever SharedTrackResult changes; 2 added status
+static const uint32_t TRACK_RESULT_CHANNEL_VERSION = 2;
+// slot headers start on their own page, pixels on their own cache line
+static const size_t SLOT_ALIGN = 4096;
+static const size_t PIXEL_ALIGN = 64;
+
+struct FrameRing::Header {
+  std::atomic<uint32_t> magic;  // stored last, with release
+  uint32_t version;
+  uint32_t slot_count;
+  int32_t width;
+  int32_t height;
+  int32_t type;
+  uint64_t slot_bytes;   // image bytes of one slot
+  uint64_t slot_stride;  // distance between slot headers
+  alignas(64) std::atomic<uint64_t> latest;  // newest complete frame, 0: none
+};
+
+struct FrameRing::SlotHeader {
+  std::atomic<uint64_t> seq;  // frame held by the slot, 0 while written
+  int64_t capture_ns;
+};
+
+static size_t alignUp(size_t v, size_t a) { return (v + a - 1) / a * a; }
+
+// create always makes a fresh object: a consumer still mapping the old one
+// (e.g. after a producer restart) keeps valid memory and simply sees no new
+// frames until it reopens
+static void* mapShared(const std::string& name, size_t& bytes, bool create,
+                       uint64_t* inode = nullptr) {
+  if (create) {
+    shm_unlink(name.c_str());
+  }
+  int fd = create ? shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0660)
+                  : shm_open(name.c_str(), O_RDWR, 0);
+  if (fd < 0) {
+    ERROR_LOG("shm_open failed, name is %s", name.c_str());
+    return nullptr;
+  }
+  if (create) {
+    if (ftruncate(fd, bytes) != 0) {
+      ERROR_LOG("ftruncate failed, name is %s, size is %zu", name.c_str(),
+                bytes);
+      ::close(fd);
+      return nullptr;
+    }
+  } else {
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+      ::close(fd);
+      return nullptr;
+    }
+    bytes = st.st_size;
+    if (inode != nullptr) {
+      *inode = st.st_ino;
+    }
+  }
+  void* base =
+      mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (base == MAP_FAILED) {
+    ERROR_LOG("mmap failed, name is %s, size is %zu", name.c_str(), bytes);
+    return nullptr;
+  }
+  return base;
+}
+
+FrameRing::FrameRing()
+    : owner_(false),
+      base_(nullptr),
+      bytes_(0),
+      inode_(0),
+      header_(nullptr),
+      write_seq_(0) {}
+
+FrameRing::~FrameRing() { close(); }
+
+Result FrameRing::create(const std::string& name, uint32_t slot_count,
+                         int width, int height, int type) {
+  close();
+  if (slot_count < 2) {
+    ERROR_LOG("frame ring needs at least 2 slots");
+    return FAILED;
+  }
+  size_t slot_bytes = (size_t)width * height * CV_ELEM_SIZE(type);
+  size_t header_bytes = alignUp(sizeof(Header), SLOT_ALIGN);
+  size_t slot_stride = alignUp(
+      alignUp(sizeof(SlotHeader), PIXEL_ALIGN) + slot_bytes, SLOT_ALIGN);
+  bytes_ = header_bytes + slot_stride * slot_count;
+  base_ = mapShared(name, bytes_, true);
+  if (base_ == nullptr) {
+    return FAILED;
+  }
+  name_ = name;
+  owner_ = true;
+  header_ = new (base_) Header();
+  header_->slot_count = slot_count;
+  header_->width = width;
+  header_->height = height;
+  header_->type = type;
+  header_->slot_bytes = slot_bytes;
+  header_->slot_stride = slot_stride;
+  header_->latest.store(0, std::memory_order_relaxed);
+  for (uint32_t i = 0; i < slot_count; ++i) {
+    SlotHeader* slot = new (slotHeader(i)) SlotHeader();
+    slot->seq.store(0, std::memory_order_relaxed);
+  }
+  header_->version = FRAME_RING_VERSION;
+  // consumers check the magic first, so it marks a fully set up ring
+  header_->magic.store(FRAME_RING_MAGIC, std::memory_order_release);
+  write_seq_ = 0;
+  return SUCCESS;
+}
+
+Result FrameRing::open(const std::string& name) {
+  close();
+  base_ = mapShared(name, bytes_, false, &inode_);
+  if (base_ == nullptr) {
+    return FAILED;
+  }
+  header_ = reinterpret_cast<Header*>(base_);
+  // the acquire pairs with the release in create, the rest of the header is
+  // only read after it
+  if (bytes_ < sizeof(Header) ||
+      header_->magic.load(std::memory_order_acquire) != FRAME_RING_MAGIC ||
+      header_->version != FRAME_RING_VERSION ||
+      bytes_ < alignUp(sizeof(Header), SLOT_ALIGN) +
+                   header_->slot_stride * header_->slot_count) {
+    ERROR_LOG("%s is not a frame ring or was not set up completely",
+              name.c_str());
+    close();
+    return FAILED;
+  }
+  // crops and hwc_to_nchw work on 8-bit BGR only
+  if (header_->type != CV_8UC3) {
+    ERROR_LOG("%s holds frames of type %d, only CV_8UC3 is supported",
+              name.c_str(), header_->type);
+    close();
+    return FAILED;
+  }
+  name_ = name;
+  owner_ = false;
+  return SUCCESS;
+}
+
+bool FrameRing::replaced() const {
+  if (base_ == nullptr || owner_) {
+    return false;
+  }
+  int fd = shm_open(name_.c_str(), O_RDONLY, 0);
+  if (fd < 0) {
+    return true;  // unlinked, the producer exited
+  }
+  struct stat st;
+  bool same = fstat(fd, &st) == 0 && st.st_ino == inode_;
+  ::close(fd);
+  return !same;
+}
+
+void FrameRing::close() {
+  if (base_ != nullptr) {
+    munmap(base_, bytes_);
+    if (owner_) {
+      shm_unlink(name_.c_str());
+    }
+  }
+  base_ = nullptr;
+  header_ = nullptr;
+  bytes_ = 0;
+  inode_ = 0;
+  owner_ = false;
+}
+
+FrameRing::SlotHeader* FrameRing::slotHeader(uint32_t index) const {
+  char* first = static_cast<char*>(base_) + alignUp(sizeof(Header), SLOT_ALIGN);
+  return reinterpret_cast<SlotHeader*>(first + header_->slot_stride * index);
+}
+
+cv::Mat FrameRing::slotImage(uint32_t index) const {
+  char* pixels = reinterpret_cast<char*>(slotHeader(index)) +
+                 alignUp(sizeof(SlotHeader), PIXEL_ALIGN);
+  return cv::Mat(header_->height, header_->width, header_->type, pixels);
+}
+
+cv::Mat FrameRing::beginWrite() {
+  uint64_t seq = write_seq_ + 1;
+  uint32_t index = seq % header_->slot_count;
+  SlotHeader* slot = slotHeader(index);
+  // readers of the frame this slot held see seq change and drop it
+  slot->seq.store(0, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  return slotImage(index);
+}
+
+void FrameRing::endWrite(int64_t capture_ns) {
+  uint64_t seq = ++write_seq_;
+  SlotHeader* slot = slotHeader(seq % header_->slot_count);
+  slot->capture_ns = capture_ns;
+  slot->seq.store(seq, std::memory_order_release);
+  header_->latest.store(seq, std::memory_order_release);
+}
+
+bool FrameRing::acquireLatest(uint64_t after_seq, FrameSlot& slot) const {
+  uint64_t seq = header_->latest.load(std::memory_order_acquire);
+  if (seq == 0 || seq <= after_seq) {
+    return false;
+  }
+  uint32_t index = seq % header_->slot_count;
+  SlotHeader* header = slotHeader(index);
+  if (header->seq.load(std::memory_order_acquire) != seq) {
+    return false;  // lapped between the two loads, try again
+  }
+  slot.img = slotImage(index);
+  slot.seq = seq;
+  slot.capture_ns = header->capture_ns;
+  return stillValid(slot);
+}
+
+bool FrameRing::stillValid(const FrameSlot& slot) const {
+  // orders the pixel reads before the re-check
+  std::atomic_thread_fence(std::memory_order_acquire);
+  SlotHeader* header = slotHeader(slot.seq % header_->slot_count);
+  return header->seq.load(std::memory_order_relaxed) == slot.seq;
+}
+
+struct TrackResultChannel::Channel {
+  std::atomic<uint32_t> magic;  // stored last, with release
+  uint32_t version;
+  Seqlock<SharedTrackResult> result;
+};
+
+TrackResultChannel::TrackResultChannel() : owner_(false), channel_(nullptr) {}
+
+TrackResultChannel::~TrackResultChannel() { close(); }
+
+Result TrackResultChannel::create(const std::string& name) {
+  close();
+  size_t bytes = sizeof(Channel);
+  void* base = mapShared(name, bytes, true);
+  if (base == nullptr) {
+    return FAILED;
+  }
+  channel_ = new (base) Channel();
+  channel_->version = TRACK_RESULT_CHANNEL_VERSION;
+  channel_->magic.store(FRAME_RING_MAGIC, std::memory_order_release);
+  name_ = name;
+  owner_ = true;
+  return SUCCESS;
+}
+
+Result TrackResultChannel::open(const std::string& name) {
+  close();
+  size_t bytes = 0;
+  void* base = mapShared(name, bytes, false);
+  if (base == nullptr) {
+    return FAILED;
+  }
+  channel_ = static_cast<Channel*>(base);
+  if (bytes < sizeof(Channel) ||
+      channel_->magic.load(std::memory_order_acquire) != FRAME_RING_MAGIC) {
+    ERROR_LOG("%s is not a track result channel", name.c_str());
+    munmap(base, bytes);
+    channel_ = nullptr;
+    return FAILED;
+  }
+  if (channel_->version != TRACK_RESULT_CHANNEL_VERSION) {
+    ERROR_LOG("%s has result layout version %u, expected %u", name.c_str(),
+              channel_->version, TRACK_RESULT_CHANNEL_VERSION);
+    munmap(base, bytes);
+    channel_ = nullptr;
+    return FAILED;
+  }
+  name_ = name;
+  owner_ = false;
+  return SUCCESS;
+}
+
+void TrackResultChannel::close() {
+  if (channel_ != nullptr) {
+    munmap(channel_, sizeof(Channel));
+    if (owner_) {
+      shm_unlink(name_.c_str());
+    }
+  }
+  channel_ = nullptr;
+  owner_ = false;
+}
+
+void TrackResultChannel::publish(const SharedTrackResult& result) {
+  channel_->result.write(result);
+}
+
+cv::Rect2f SharedTrackResult::extrapolate(int64_t now_ns) const {
+  float dt = static_cast<float>(now_ns - capture_ns) * 1e-9f;
+  return cv::Rect2f(x + vx * dt, y + vy * dt, width, height);
+}
+
+bool TrackResultChannel::latest(SharedTrackResult& result) const {
+  if (channel_->result.version() == 0) {
+    return false;
+  }
+  channel_->result.read(result);
+  return true;
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+#include <opencv2/core/core.hpp>
+#include <string>
+
+#include "common.h"
+#include "seqlock.h"
+
+// Frame transport from a separate capture process. The producer owns a POSIX
+// shared-memory ring of fixed-size frame slots and overwrites the oldest slot
+// for every new frame; the tracker only ever looks at the newest one and
+// crops straight out of the shared slot, no copy and no syscall per frame.
+//
+// Neither side blocks the other: each slot carries the sequence number of the
+// frame it holds (0 while being written), and the consumer re-checks it after
+// use to detect that the producer lapped it.
+
+struct FrameSlot {
+  cv::Mat img;  // header over the shared slot, valid while the ring is open
+  uint64_t seq;
+  int64_t capture_ns;  // CLOCK_MONOTONIC, shared by both processes
+};
+
+class FrameRing {
+ public:
+  FrameRing();
+  ~FrameRing();
+
+  // producer side, replaces an existing ring of the same name
+  Result create(const std::string& name, uint32_t slot_count, int width,
+                int height, int type);
+  // consumer side, CV_8UC3 frames only
+  Result open(const std::string& name);
+  void close();
+
+  // producer: fill the returned image, then publish it with endWrite
+  cv::Mat beginWrite();
+  void endWrite(int64_t capture_ns);
+
+  // consumer: newest frame with seq > after_seq, false if there is none
+  bool acquireLatest(uint64_t after_seq, FrameSlot& slot) const;
+  // false once the producer started overwriting the slot's frame
+  bool stillValid(const FrameSlot& slot) const;
+  // consumer: true once the name refers to a different ring than the one
+  // mapped (a restarted producer creates a new one) or to none at all. The
+  // old mapping then never sees another frame and has to be reopened. Costs
+  // a shm_open, call it only when frames stopped coming.
+  bool replaced() const;
+
+ private:
+  struct Header;
+  struct SlotHeader;
+
+  SlotHeader* slotHeader(uint32_t index) const;
+  cv::Mat slotImage(uint32_t index) const;
+
+  std::string name_;
+  bool owner_;
+  void* base_;
+  size_t bytes_;
+  uint64_t inode_;  // of the mapped object, for replaced()
+  Header* header_;
+  uint64_t write_seq_;
+};
+
+enum TrackResultStatus {
+  TRACK_RESULT_TRACKED = 0,
+  // no prediction for the frame (inference failed): the box is the last
+  // tracked one and the score 0, not a low-confidence track
+  TRACK_RESULT_HELD = 1
+};
+
+// latest tracking result, published in-process (ResultPublisher) and back
+// to the capture side
+struct SharedTrackResult {
+  uint64_t frame_seq;
+  float x, y, width, height;
+  float score;
+  // box centre velocity in pixels per second, measured between the capture
+  // timestamps of successive tracked frames
+  float vx, vy;
+  int32_t status;  // TrackResultStatus
+  int64_t capture_ns;
+  int64_t publish_ns;
+
+  // the box moved on to where it should be at now_ns (CLOCK_MONOTONIC)
+  cv::Rect2f extrapolate(int64_t now_ns) const;
+};
+
+class TrackResultChannel {
+ public:
+  TrackResultChannel();
+  ~TrackResultChannel();
+
+  Result create(const std::string& name);  // tracker side
+  // capture side, fails on a channel of another layout version
+  Result open(const std::string& name);
+  void close();
+
+  void publish(const SharedTrackResult& result);
+  // false if nothing was published yet
+  bool latest(SharedTrackResult& result) const;
+
+ private:
+  struct Channel;
+
+  std::string name_;
+  bool owner_;
+  Channel* channel_;
+};
@@ -2,29 +2,53 @@
 
 #include <opencv2/opencv.hpp>
 
-Head::Head(const char* modelPath) {
+Head::Head(const char* modelPath, const char* tag)
+    : tag_(tag),
+      modelId_(0),
+      modelWorkSize_(0),
+      modelWeightSize_(0),
+      modelWorkPtr_(nullptr),
+      modelWeightPtr_(nullptr),
+      modelDesc_(nullptr),
+      modelLoaded_(false),
+      loaded_(false),
+      inputDataset_n(nullptr),
+      outputDataset_n(nullptr),
+      inputBuffer_n1(nullptr),
+      outputBuffer_n1(nullptr),
+      inputBufferSize_n1(0),
+      inputBuffer_n2(nullptr),
+      outputBuffer_n2(nullptr),
+      inputBufferSize_n2(0),
+      outputHost_n1(nullptr),
+      outputHost_n2(nullptr) {
   aclError ret = aclmdlQuerySize(modelPath, &modelWorkSize_, &modelWeightSize_);
   if (ret != ACL_SUCCESS) {
     ERROR_LOG("query model failed, model file is %s, errorCode is %d",
               modelPath, static_cast<int32_t>(ret));
+    return;
   }
   // using ACL_MEM_MALLOC_HUGE_FIRST to malloc memory, huge memory is preferred
   // to use and huge memory can improve performance.
-  ret = aclrtMalloc(&modelWorkPtr_, modelWorkSize_, ACL_MEM_MALLOC_HUGE_FIRST);
+  MemAccount& mem = MemAccount::instance();
+  ret = mem.malloc(&modelWorkPtr_, modelWorkSize_, ACL_MEM_MALLOC_HUGE_FIRST,
+                   tag_ + "/work");
   if (ret != ACL_SUCCESS) {
     ERROR_LOG(
         "malloc buffer for work failed, require size is %zu, errorCode is %d",
         modelWorkSize_, static_cast<int32_t>(ret));
+    return;
   }
 
   // using ACL_MEM_MALLOC_HUGE_FIRST to malloc memory, huge memory is preferred
   // to use and huge memory can improve performance.
-  ret = aclrtMalloc(&modelWeightPtr_, modelWeightSize_,
-                    ACL_MEM_MALLOC_HUGE_FIRST);
+  ret = mem.malloc(&modelWeightPtr_, modelWeightSize_,
+                   ACL_MEM_MALLOC_HUGE_FIRST, tag_ + "/weight");
   if (ret != ACL_SUCCESS) {
     ERROR_LOG(
         "malloc buffer for weight failed, require size is %zu, errorCode is %d",
         modelWeightSize_, static_cast<int32_t>(ret));
+    return;
   }
 
   ret = aclmdlLoadFromFileWithMem(modelPath, &modelId_, modelWorkPtr_,
@@ -33,55 +57,85 @@ Head::Head(const char* modelPath) {
   if (ret != ACL_SUCCESS) {
     ERROR_LOG("load model from file failed, model file is %s, errorCode is %d",
               modelPath, static_cast<int32_t>(ret));
+    return;
   }
+  modelLoaded_ = true;
 
   modelDesc_ = aclmdlCreateDesc();
   if (modelDesc_ == nullptr) {
     ERROR_LOG("create model description failed");
+    return;
   }
 
   ret = aclmdlGetDesc(modelDesc_, modelId_);
   if (ret != ACL_SUCCESS) {
     ERROR_LOG("get model description failed, modelId is %u, errorCode is %d",
               modelId_, static_cast<int32_t>(ret));
+    return;
   }
+  loaded_ = true;
 }
 Head::~Head() {
   aclError ret;
+  MemAccount& mem = MemAccount::instance();
   // release resource includes acl resource, data set and unload model
-  aclrtFree(inputBuffer_n1);
+  mem.free(inputBuffer_n1);
   inputBuffer_n1 = nullptr;
-  aclrtFree(inputBuffer_n2);
+  mem.free(inputBuffer_n2);
   inputBuffer_n2 = nullptr;
-  (void)aclmdlDestroyDataset(inputDataset_n);
+  destroyDataset(inputDataset_n);
   inputDataset_n = nullptr;
 
-  aclrtFree(outputBuffer_n1);
+  mem.free(outputBuffer_n1);
   outputBuffer_n1 = nullptr;
-  aclrtFree(outputBuffer_n2);
+  mem.free(outputBuffer_n2);
   outputBuffer_n2 = nullptr;
-  (void)aclmdlDestroyDataset(outputDataset_n);
+  destroyDataset(outputDataset_n);
   outputDataset_n = nullptr;
 
-  ret = aclmdlDestroyDesc(modelDesc_);
-  if (ret != ACL_SUCCESS) {
-    ERROR_LOG("destroy description failed, errorCode is %d", ret);
+  mem.freeHost(outputHost_n1);
+  outputHost_n1 = nullptr;
+  mem.freeHost(outputHost_n2);
+  outputHost_n2 = nullptr;
+
+  if (modelDesc_ != nullptr) {
+    ret = aclmdlDestroyDesc(modelDesc_);
+    if (ret != ACL_SUCCESS) {
+      ERROR_LOG("destroy description failed, errorCode is %d", ret);
+    }
   }
 
-  ret = aclmdlUnload(modelId_);
-  if (ret != ACL_SUCCESS) {
-    ERROR_LOG("unload model failed, errorCode is %d", ret);
+  if (modelLoaded_) {
+    ret = aclmdlUnload(modelId_);
+    if (ret != ACL_SUCCESS) {
+      ERROR_LOG("unload model failed, errorCode is %d", ret);
+    }
   }
+  mem.free(modelWorkPtr_);
+  modelWorkPtr_ = nullptr;
+  mem.free(modelWeightPtr_);
+  modelWeightPtr_ = nullptr;
 }
 
 Result Head::head_initDatasets() {
+  if (!loaded_) {
+    ERROR_LOG("head_initDatasets: %s model not loaded", tag_.c_str());
+    return FAILED;
+  }
   aclError ret;
+  MemAccount& mem = MemAccount::instance();
   // create data set of input
   inputDataset_n = aclmdlCreateDataset();
 
   inputBufferSize_n1 = aclmdlGetInputSizeByIndex(modelDesc_, 0);
   const char* inputname_1 = aclmdlGetInputNameByIndex(modelDesc_, 0);
-  aclrtMalloc(&inputBuffer_n1, inputBufferSize_n1, ACL_MEM_MALLOC_HUGE_FIRST);
+  ret = mem.malloc(&inputBuffer_n1, inputBufferSize_n1, ACL_MEM_MALLOC_HUGE_FIRST,
+                   tag_ + "/input");
+  if (ret != ACL_SUCCESS) {
+    ERROR_LOG("malloc inputBuffer_n1 failed, require size is %zu, errorCode is %d",
+              inputBufferSize_n1, ret);
+    return FAILED;
+  }
   aclDataBuffer* inputData_n1 =
       aclCreateDataBuffer(inputBuffer_n1, inputBufferSize_n1);
   ret = aclmdlAddDatasetBuffer(inputDataset_n, inputData_n1);
@@ -96,7 +150,13 @@ Result Head::head_initDatasets() {
 
   inputBufferSize_n2 = aclmdlGetInputSizeByIndex(modelDesc_, 1);
   const char* inputname_2 = aclmdlGetInputNameByIndex(modelDesc_, 1);
-  aclrtMalloc(&inputBuffer_n2, inputBufferSize_n2, ACL_MEM_MALLOC_HUGE_FIRST);
+  ret = mem.malloc(&inputBuffer_n2, inputBufferSize_n2, ACL_MEM_MALLOC_HUGE_FIRST,
+                   tag_ + "/input");
+  if (ret != ACL_SUCCESS) {
+    ERROR_LOG("malloc inputBuffer_n2 failed, require size is %zu, errorCode is %d",
+              inputBufferSize_n2, ret);
+    return FAILED;
+  }
   aclDataBuffer* inputData_n2 =
       aclCreateDataBuffer(inputBuffer_n2, inputBufferSize_n2);
   ret = aclmdlAddDatasetBuffer(inputDataset_n, inputData_n2);
@@ -112,7 +172,13 @@ Result Head::head_initDatasets() {
   // create data set of output
   outputDataset_n = aclmdlCreateDataset();
   modelOutputSize_n1 = aclmdlGetOutputSizeByIndex(modelDesc_, 0);
-  aclrtMalloc(&outputBuffer_n1, modelOutputSize_n1, ACL_MEM_MALLOC_HUGE_FIRST);
+  ret = mem.malloc(&outputBuffer_n1, modelOutputSize_n1, ACL_MEM_MALLOC_HUGE_FIRST,
+                   tag_ + "/output");
+  if (ret != ACL_SUCCESS) {
+    ERROR_LOG("malloc outputBuffer_n1 failed, require size is %zu, errorCode is %d",
+              modelOutputSize_n1, ret);
+    return FAILED;
+  }
   aclDataBuffer* outputData_n1 =
       aclCreateDataBuffer(outputBuffer_n1, modelOutputSize_n1);
   ret = aclmdlAddDatasetBuffer(outputDataset_n, outputData_n1);
@@ -124,7 +190,13 @@ Result Head::head_initDatasets() {
   }
 
   modelOutputSize_n2 = aclmdlGetOutputSizeByIndex(modelDesc_, 1);
-  aclrtMalloc(&outputBuffer_n2, modelOutputSize_n2, ACL_MEM_MALLOC_HUGE_FIRST);
+  ret = mem.malloc(&outputBuffer_n2, modelOutputSize_n2, ACL_MEM_MALLOC_HUGE_FIRST,
+                   tag_ + "/output");
+  if (ret != ACL_SUCCESS) {
+    ERROR_LOG("malloc outputBuffer_n2 failed, require size is %zu, errorCode is %d",
+              modelOutputSize_n2, ret);
+    return FAILED;
+  }
   aclDataBuffer* outputData_n2 =
       aclCreateDataBuffer(outputBuffer_n2, modelOutputSize_n2);
   ret = aclmdlAddDatasetBuffer(outputDataset_n, outputData_n2);
@@ -135,10 +207,23 @@ Result Head::head_initDatasets() {
     INFO_LOG("aclmdlAddDatasetBuffer n2 success");
   }
 
+  // host copies of the outputs are allocated once here instead of per frame
+  ret = mem.mallocHost(&outputHost_n1, modelOutputSize_n1, tag_ + "/host");
+  if (ret != ACL_SUCCESS) {
+    ERROR_LOG("malloc host output n1 failed, errorCode is %d", ret);
+    return FAILED;
+  }
+  ret = mem.mallocHost(&outputHost_n2, modelOutputSize_n2, tag_ + "/host");
+  if (ret != ACL_SUCCESS) {
+    ERROR_LOG("malloc host output n2 failed, errorCode is %d", ret);
+    return FAILED;
+  }
+
   return SUCCESS;
 }
 
 Result Head::head_Inference(void* input_data0, void* input_data1) {
+  TRACE_SPAN("head_Inference");
   // copy host datainputs to device
   aclError ret = aclrtMemcpy(inputBuffer_n1, inputBufferSize_n1, input_data0,
                              inputBufferSize_n1, ACL_MEMCPY_HOST_TO_DEVICE);
@@ -162,8 +247,13 @@ Result Head::head_Inference(void* input_data0, void* input_data1) {
 }
 
 Result Head::head_GetResults(std::vector<cv::Mat>& output) {
+  TRACE_SPAN("head_GetResults");
   aclError ret;
   uint32_t output_num = aclmdlGetNumOutputs(modelDesc_);
+  if (output_num != 2) {
+    ERROR_LOG("head model has %u outputs, expected 2", output_num);
+    return FAILED;
+  }
   output.resize(output_num);
 
   for (uint32_t i = 0; i < output_num; ++i) {
@@ -191,11 +281,10 @@ Result Head::head_GetResults(std::vector<cv::Mat>& output) {
       total_count *= shape[j];
     }
 
-    void* hostData = nullptr;
-    ret = aclrtMallocHost(&hostData, dataLen);
-    if (ret != ACL_SUCCESS) {
-      ERROR_LOG("aclrtMallocHost failed, size = %u, errorCode = %d", dataLen,
-                ret);
+    void* hostData = i == 0 ? outputHost_n1 : outputHost_n2;
+    size_t hostSize = i == 0 ? modelOutputSize_n1 : modelOutputSize_n2;
+    if (hostData == nullptr || dataLen > hostSize) {
+      ERROR_LOG("host buffer for output %d missing or too small", i);
       return FAILED;
     }
 
@@ -203,7 +292,6 @@ Result Head::head_GetResults(std::vector<cv::Mat>& output) {
                       ACL_MEMCPY_DEVICE_TO_HOST);
     if (ret != ACL_SUCCESS) {
       ERROR_LOG("aclrtMemcpy failed for output %d, errorCode = %d", i, ret);
-      aclrtFreeHost(hostData);
       return FAILED;
     }
 
@@ -211,8 +299,6 @@ Result Head::head_GetResults(std::vector<cv::Mat>& output) {
     cv::Mat mat(dims.dimCount, shape.data(), CV_32F, outData);
 
     output[i] = mat.clone();
-
-    aclrtFreeHost(hostData);
   }
 
   return SUCCESS;
@@ -220,6 +306,7 @@ Result Head::head_GetResults(std::vector<cv::Mat>& output) {
 
 Result Head::runHead(std::vector<cv::Mat>& output, void*& input_data0,
                      void*& input_data1) {
+  TRACE_SPAN("Head::runHead");
   Result ret;
 
   //推理
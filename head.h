@@ -5,16 +5,22 @@
 
 #include "acl.h"
 #include "backbone.h"
-
-#define INFO_LOG(fmt, ...)                             \
-  fprintf(stdout, "[INFO]  " fmt "\n", ##__VA_ARGS__); \
-  fflush(stdout)
-#define ERROR_LOG(fmt, ...) fprintf(stderr, "[ERROR] " fmt "\n", ##__VA_ARGS__)
+#include "common.h"
+#include "trace.h"
 
 class Head {
  public:
-  Head(const char* modelPath);
+  Head(const char* modelPath, const char* tag = "head");
   ~Head();
+  // the model file was loaded and described; false after any failure in the
+  // constructor, in which case initDatasets fails as well
+  bool loaded() const { return loaded_; }
+  // bytes the model takes for input 0 (template feature) and 1 (search
+  // feature), as aclmdlGetInputSizeByIndex reports them; 0 before
+  // head_initDatasets
+  size_t inputSize(size_t index) const {
+    return index == 0 ? inputBufferSize_n1 : inputBufferSize_n2;
+  }
   Result head_initDatasets();
   Result head_Inference(void* input_data0, void* input_data1);
   Result head_GetResults(std::vector<cv::Mat>& output);
@@ -22,12 +28,15 @@ class Head {
                  void*& input_data1);
 
  private:
+  std::string tag_;
   uint32_t modelId_;
   size_t modelWorkSize_;    // model work memory buffer size
   size_t modelWeightSize_;  // model weight memory buffer size
   void* modelWorkPtr_;      // model work memory buffer
   void* modelWeightPtr_;    // model weight memory buffer
   aclmdlDesc* modelDesc_;
+  bool modelLoaded_;  // modelId_ needs unloading
+  bool loaded_;
 
   aclmdlDataset* inputDataset_n;
   aclmdlDataset* outputDataset_n;
@@ -39,4 +48,7 @@ class Head {
   void* outputBuffer_n2;
   size_t inputBufferSize_n2;
   size_t modelOutputSize_n2;
-};
\ No newline at end of file
+  // host copies of the outputs, reused per frame
+  void* outputHost_n1;
+  void* outputHost_n2;
+};
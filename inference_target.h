@@ -0,0 +1,55 @@
+#pragma once
+
+#include <opencv2/core/core.hpp>
+#include <string>
+#include <vector>
+
+#include "common.h"
+
+enum BackboneModel { BACKBONE_T = 0, BACKBONE_X = 1 };
+
+// Something that can run the NanoTrack backbones and head: the ACL device
+// (AclTarget) or the CPU (CpuTarget). Features are float NCHW blobs in the
+// layout of the backbone output, so a template encoded on one target can be
+// correlated on another.
+class InferenceTarget {
+ public:
+  virtual ~InferenceTarget() {}
+
+  virtual const std::string& name() const = 0;
+  // called on a thread the dispatcher starts (latency probes) before it runs
+  // anything there; targets with per-thread state bind it here
+  virtual Result attachThread() { return SUCCESS; }
+  // crop: BGR uint8, EXEMPLAR_SIZE (T) or INSTANCE_SIZE (X) square
+  virtual Result runBackbone(BackboneModel model, const cv::Mat& crop,
+                             cv::Mat& feature) = 0;
+  // outputs[0]: cls (1, 2, 16, 16), outputs[1]: loc (1, 4, 16, 16)
+  virtual Result runHead(const cv::Mat& feature_T, const cv::Mat& feature_X,
+                         std::vector<cv::Mat>& outputs) = 0;
+
+  // Batched forms for throughput callers (OfflineEngine), the items are
+  // independent. The defaults run them one at a time; targets whose models
+  // take a batch dimension override them.
+  virtual Result runBackboneBatch(BackboneModel model,
+                                  const std::vector<cv::Mat>& crops,
+                                  std::vector<cv::Mat>& features) {
+    features.resize(crops.size());
+    for (size_t i = 0; i < crops.size(); ++i) {
+      if (runBackbone(model, crops[i], features[i]) != SUCCESS) {
+        return FAILED;
+      }
+    }
+    return SUCCESS;
+  }
+  virtual Result runHeadBatch(const std::vector<cv::Mat>& features_T,
+                              const std::vector<cv::Mat>& features_X,
+                              std::vector<std::vector<cv::Mat>>& outputs) {
+    outputs.resize(features_X.size());
+    for (size_t i = 0; i < features_X.size(); ++i) {
+      if (runHead(features_T[i], features_X[i], outputs[i]) != SUCCESS) {
+        return FAILED;
+      }
+    }
+    return SUCCESS;
+  }
+};
@@ -0,0 +1,143 @@
+#include "jpeg_source.h"
+
+#include <setjmp.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+
+#include <jpeglib.h>
+
+struct JpegErrorMgr {
+  jpeg_error_mgr pub;
+  jmp_buf jump;
+};
+
+// libjpeg calls exit() on errors by default, jump back to the caller instead
+static void jpegErrorExit(j_common_ptr cinfo) {
+  JpegErrorMgr* err = reinterpret_cast<JpegErrorMgr*>(cinfo->err);
+  char msg[JMSG_LENGTH_MAX];
+  (*cinfo->err->format_message)(cinfo, msg);
+  ERROR_LOG("jpeg decode failed: %s", msg);
+  longjmp(err->jump, 1);
+}
+
+JpegSource::JpegSource() {}
+
+JpegSource::~JpegSource() {}
+
+Result JpegSource::loadFile(const std::string& path) {
+  std::ifstream f(path, std::ios::binary | std::ios::ate);
+  if (!f.good()) {
+    ERROR_LOG("open image failed, file is %s", path.c_str());
+    return FAILED;
+  }
+  std::streamsize len = f.tellg();
+  f.seekg(0, std::ios::beg);
+  // buffer is reused across frames to avoid a reallocation per image
+  fileData_.resize(len);
+  if (len <= 0 || !f.read(reinterpret_cast<char*>(fileData_.data()), len)) {
+    ERROR_LOG("read image failed, file is %s", path.c_str());
+    return FAILED;
+  }
+  return SUCCESS;
+}
+
+Result JpegSource::read(const std::string& path, cv::Mat& frame) {
+  FrameRegion region;
+  Result ret = readRegion(path, cv::Rect2f(), 0, region);
+  if (ret != SUCCESS) {
+    return FAILED;
+  }
+  frame = region.img;
+  return SUCCESS;
+}
+
+Result JpegSource::readRegion(const std::string& path,
+                              const cv::Rect2f& region, int model_sz,
+                              FrameRegion& out) {
+  TRACE_SPAN("JpegSource::readRegion");
+  if (loadFile(path) != SUCCESS) {
+    return FAILED;
+  }
+
+  jpeg_decompress_struct cinfo;
+  JpegErrorMgr jerr;
+  cinfo.err = jpeg_std_error(&jerr.pub);
+  jerr.pub.error_exit = jpegErrorExit;
+  if (setjmp(jerr.jump)) {
+    jpeg_destroy_decompress(&cinfo);
+    return FAILED;
+  }
+  jpeg_create_decompress(&cinfo);
+  jpeg_mem_src(&cinfo, fileData_.data(), fileData_.size());
+  if (jpeg_read_header(&cinfo, TRUE) != JPEG_HEADER_OK) {
+    ERROR_LOG("no jpeg header, file is %s", path.c_str());
+    jpeg_destroy_decompress(&cinfo);
+    return FAILED;
+  }
+  cinfo.out_color_space = JCS_EXT_BGR;
+
+  int im_w = cinfo.image_width, im_h = cinfo.image_height;
+  int x0 = 0, y0 = 0, x1 = im_w, y1 = im_h;
+  int denom = 1;
+  if (region.area() > 0) {
+    // keep at least one pixel so a target that left the frame still yields
+    // a valid (fully padded) crop
+    x0 = std::min(im_w - 1, std::max(0, (int)std::floor(region.x)));
+    y0 = std::min(im_h - 1, std::max(0, (int)std::floor(region.y)));
+    x1 = std::max(x0 + 1, std::min(im_w, (int)std::ceil(region.br().x)));
+    y1 = std::max(y0 + 1, std::min(im_h, (int)std::ceil(region.br().y)));
+    // the crop is resized to model_sz afterwards, so let the IDCT do the
+    // downscaling as long as no upsampling is needed later
+    float side = std::min(region.width, region.height);
+    while (denom < 8 && side / (denom * 2) >= model_sz) {
+      denom *= 2;
+    }
+  }
+  cinfo.scale_num = 1;
+  cinfo.scale_denom = denom;
+  jpeg_start_decompress(&cinfo);
+
+  // one extra column and row per side: fancy chroma upsampling replicates
+  // the edge column of a cropped scanline and the edge row after a skip, so
+  // only interior pixels match a full decode
+  JDIMENSION xoff = std::max(0, x0 / denom - 1);
+  JDIMENSION xend = std::min((JDIMENSION)((x1 + denom - 1) / denom + 1),
+                             cinfo.output_width);
+  JDIMENSION width = xend - xoff;
+  JDIMENSION yoff = std::max(0, y0 / denom - 1);
+  JDIMENSION yend = std::min((JDIMENSION)((y1 + denom - 1) / denom + 1),
+                             cinfo.output_height);
+  // moves xoff back to an iMCU boundary and widens width to match
+  if (width < cinfo.output_width) {
+    jpeg_crop_scanline(&cinfo, &xoff, &width);
+  }
+  if (yoff > 0 && jpeg_skip_scanlines(&cinfo, yoff) != yoff) {
+    ERROR_LOG("skipping %u rows failed, file is %s", yoff, path.c_str());
+    jpeg_destroy_decompress(&cinfo);
+    return FAILED;
+  }
+
+  out.img.create(yend - yoff, cinfo.output_width, CV_8UC3);
+  while (cinfo.output_scanline < yend) {
+    JSAMPROW row = out.img.ptr<unsigned char>(cinfo.output_scanline - yoff);
+    if (jpeg_read_scanlines(&cinfo, &row, 1) != 1) {
+      ERROR_LOG("reading row %u failed, file is %s", cinfo.output_scanline,
+                path.c_str());
+      jpeg_destroy_decompress(&cinfo);
+      return FAILED;
+    }
+  }
+  // rows below the region are never decoded
+  jpeg_destroy_decompress(&cinfo);
+
+  // decoded pixel i covers frame pixels [i * denom, (i + 1) * denom), map
+  // pixel centres onto each other
+  out.scale = 1.0f / denom;
+  out.offset = cv::Point2f(xoff * denom + 0.5f * (denom - 1),
+                           yoff * denom + 0.5f * (denom - 1));
+  out.frame_size = cv::Size(im_w, im_h);
+  return SUCCESS;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "nanotrack.h"
+
+// Image-sequence reader built on libjpeg-turbo. Besides full decodes it can
+// decode just the MCU rows/columns covering the tracker's search region and,
+// when that region gets shrunk to the model input anyway, decode it directly
+// at 1/2, 1/4 or 1/8 scale in the DCT domain.
+class JpegSource {
+ public:
+  JpegSource();
+  ~JpegSource();
+
+  // full-frame BGR decode, used for the init frame (needs mean(img))
+  Result read(const std::string& path, cv::Mat& frame);
+  // decodes region (frame coordinates, clipped to the frame) at the coarsest
+  // scale that still leaves at least model_sz pixels across it
+  Result readRegion(const std::string& path, const cv::Rect2f& region,
+                    int model_sz, FrameRegion& out);
+
+ private:
+  Result loadFile(const std::string& path);
+
+  std::vector<unsigned char> fileData_;
+};
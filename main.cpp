@@ -1,20 +1,158 @@
+#include <unistd.h>
+
+#include <cstdlib>
+#include <fstream>
 #include <iostream>
+#include <sstream>
+#include "jpeg_source.h"
 #include "nanotrack_app.h"
 
+// without new frames for this long, check whether the producer restarted
+static const int64_t RING_IDLE_CHECK_NS = 2000000000LL;
+
+// tracks frames a capture process publishes into FrameRing ring_name, results
+// go back through the TrackResultChannel <ring_name>_result. A restarted
+// producer replaces the ring; the tracker then reopens it and starts over
+// from init_bbox.
+static int runSharedMemory(NanoTrackApp& nanotrack_app, const std::string& ring_name,
+                           cv::Rect init_bbox) {
+    TrackResultChannel results;
+    if (results.create(ring_name + "_result") != SUCCESS) {
+        return 1;
+    }
+    FrameRing ring;
+    for (;;) {
+        while (ring.open(ring_name) != SUCCESS) {
+            sleep(1);
+        }
+        INFO_LOG("tracking frames from %s", ring_name.c_str());
+        bool initialized = false;
+        uint64_t last_seq = 0;
+        int64_t last_frame_ns = Trace::nowNs();
+        for (;;) {
+            bool got_frame = false;
+            if (!initialized) {
+                // the template must come from a frame that was not overwritten meanwhile
+                FrameSlot slot;
+                if (ring.acquireLatest(0, slot)) {
+                    nanotrack_app.init(slot.img, init_bbox);
+                    initialized = ring.stillValid(slot);
+                    last_seq = slot.seq;
+                    got_frame = initialized;
+                }
+            } else {
+                // a frame whose inference failed is consumed too (published as held)
+                uint64_t seen_seq = last_seq;
+                cv::Rect track_bbox;
+                float track_score;
+                nanotrack_app.track(ring, last_seq, track_bbox, track_score, &results);
+                got_frame = last_seq != seen_seq;
+            }
+            int64_t now_ns = Trace::nowNs();
+            if (got_frame) {
+                last_frame_ns = now_ns;
+                continue;
+            }
+            if (now_ns - last_frame_ns > RING_IDLE_CHECK_NS) {
+                if (ring.replaced()) {
+                    ERROR_LOG("%s was replaced by a new producer, reopening", ring_name.c_str());
+                    break;
+                }
+                last_frame_ns = now_ns;
+            }
+            usleep(500);
+        }
+    }
+    return 0;
+}
+
+// list_file has one clip per line: <dir> <frame_count> <x> <y> <w> <h>, frames
+// are <dir>/0.jpg .. <dir>/<frame_count - 1>.jpg and the box is the target in
+// 0.jpg. Boxes and scores go to <dir>/nanotrack.txt.
+static int runOffline(NanoTrackApp& nanotrack_app, const std::string& list_file,
+                      const OfflinePolicy& policy) {
+    std::ifstream list(list_file);
+    if (!list) {
+        std::cerr << "cannot open " << list_file << "\n";
+        return 1;
+    }
+    std::vector<std::string> dirs;
+    std::vector<OfflineSequence> sequences;
+    std::string line;
+    while (std::getline(list, line)) {
+        std::istringstream fields(line);
+        std::string dir;
+        int count;
+        OfflineSequence sequence;
+        cv::Rect& box = sequence.init_bbox;
+        if (!(fields >> dir >> count >> box.x >> box.y >> box.width >> box.height)) {
+            continue;
+        }
+        for (int i = 0; i < count; i++) {
+            sequence.frames.push_back(dir + "/" + std::to_string(i) + ".jpg");
+        }
+        dirs.push_back(dir);
+        sequences.push_back(sequence);
+    }
+    std::vector<OfflineSequenceResult> results;
+    OfflineStats stats;
+    Result ret = nanotrack_app.runOffline(sequences, policy, results, &stats);
+    for (size_t i = 0; i < results.size(); i++) {
+        std::ofstream out(dirs[i] + "/nanotrack.txt");
+        for (size_t j = 0; j < results[i].boxes.size(); j++) {
+            const cv::Rect& box = results[i].boxes[j];
+            out << box.x << " " << box.y << " " << box.width << " " << box.height << " "
+                << results[i].scores[j] << "\n";
+        }
+    }
+    OfflineEngine::printStats(stats);
+    return ret == SUCCESS ? 0 : 1;
+}
+
 int main(int argc, char* argv[]) {
     NanoTrackApp nanotrack_app;
     nanotrack_app.initialize();
-    cv::Mat first_frame = cv::imread("/app/sd/imgs/0.jpg");
+    if (argc == 7 && std::string(argv[1]) == "--shm") {
+        return runSharedMemory(nanotrack_app, argv[2],
+                               cv::Rect(atoi(argv[3]), atoi(argv[4]), atoi(argv[5]), atoi(argv[6])));
+    }
+    if (argc >= 3 && std::string(argv[1]) == "--offline") {
+        OfflinePolicy policy;
+        if (argc >= 4) policy.max_batch = atoi(argv[3]);
+        if (argc >= 5) policy.max_wait_ms = atof(argv[4]);
+        return runOffline(nanotrack_app, argv[2], policy);
+    }
+    JpegSource source;
+    cv::Mat first_frame;
+    source.read("/app/sd/imgs/0.jpg", first_frame);
     nanotrack_app.init(first_frame, cv::Rect(499, 96, 137, 226));
+    // drawing needs a second, full decode of every frame, so it stays out of
+    // the loop unless asked for
+    const bool draw_results = getenv("NANOTRACK_DRAW_RESULTS") != nullptr;
     for (int i = 1; i < 21; i++) {
         cv::Rect track_bbox;
         float track_score;
-        cv::Mat frame = cv::imread("/app/sd/imgs/" + std::to_string(i) + ".jpg");
-        nanotrack_app.track(frame, track_bbox, track_score);
-        cv::rectangle(frame, track_bbox, cv::Scalar(0, 255, 0), 2);
-        cv::putText(frame, std::to_string(track_score), cv::Point(track_bbox.x, track_bbox.y), cv::FONT_HERSHEY_SIMPLEX, 0.5, cv::Scalar(0, 255, 0), 2);
+        // only the search region around the last position is decoded
+        int64_t capture_ns = Trace::nowNs();
+        FrameRegion region;
+        if (source.readRegion("/app/sd/imgs/" + std::to_string(i) + ".jpg",
+                              nanotrack_app.searchRegion(), INSTANCE_SIZE, region) != SUCCESS) {
+            break;
+        }
+        nanotrack_app.track(region, capture_ns, track_bbox, track_score);
         std::cout << "++++++++++++++++ score: " << track_score << std::endl;
+        if (!draw_results) {
+            continue;
+        }
+        // the region changes size and origin every frame, results are drawn on
+        // the full frame, decoded separately
+        cv::Mat frame;
+        if (source.read("/app/sd/imgs/" + std::to_string(i) + ".jpg", frame) != SUCCESS) {
+            break;
+        }
+        cv::rectangle(frame, track_bbox, cv::Scalar(0, 255, 0), 2);
+        cv::putText(frame, std::to_string(track_score), track_bbox.tl(), cv::FONT_HERSHEY_SIMPLEX, 0.5, cv::Scalar(0, 255, 0), 2);
         cv::imwrite("/app/sd/results/" + std::to_string(i) + ".jpg", frame);
     }
     return 0;
-}
\ No newline at end of file
+}
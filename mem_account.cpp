@@ -0,0 +1,172 @@
+#include "mem_account.h"
+
+#include <algorithm>
+
+MemAccount& MemAccount::instance() {
+  static MemAccount account;
+  return account;
+}
+
+MemAccount::MemAccount() : device_budget_(0), host_budget_(0) {
+  device_.current = device_.peak = 0;
+  host_.current = host_.peak = 0;
+}
+
+bool MemAccount::reserve(size_t size, bool device, const std::string& tag) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  size_t budget = device ? device_budget_ : host_budget_;
+  Totals& total = device ? device_ : host_;
+  if (budget != 0 && total.current + size > budget) {
+    ERROR_LOG("%s memory budget exceeded by %s: %zu + %zu > %zu bytes",
+              device ? "device" : "host", tag.c_str(), total.current, size,
+              budget);
+    return false;
+  }
+  std::map<std::string, Totals>& tags = device ? device_tags_ : host_tags_;
+  std::map<std::string, Totals>::iterator it = tags.find(tag);
+  if (it == tags.end()) {
+    Totals zero = {0, 0};
+    it = tags.insert(std::make_pair(tag, zero)).first;
+  }
+  it->second.current += size;
+  it->second.peak = std::max(it->second.peak, it->second.current);
+  total.current += size;
+  total.peak = std::max(total.peak, total.current);
+  return true;
+}
+
+void MemAccount::add(void* ptr, size_t size, bool device,
+                     const std::string& tag) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Allocation& alloc = allocations_[ptr];
+  alloc.tag = tag;
+  alloc.size = size;
+  alloc.device = device;
+}
+
+void MemAccount::release(size_t size, bool device, const std::string& tag) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  uncharge(size, device, tag);
+}
+
+bool MemAccount::remove(void* ptr, bool device) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::unordered_map<void*, Allocation>::iterator it = allocations_.find(ptr);
+  if (it == allocations_.end() || it->second.device != device) {
+    return false;
+  }
+  uncharge(it->second.size, device, it->second.tag);
+  allocations_.erase(it);
+  return true;
+}
+
+void MemAccount::uncharge(size_t size, bool device, const std::string& tag) {
+  Totals& total = device ? device_ : host_;
+  std::map<std::string, Totals>& tags = device ? device_tags_ : host_tags_;
+  tags[tag].current -= size;
+  total.current -= size;
+}
+
+aclError MemAccount::malloc(void** ptr, size_t size,
+                            aclrtMemMallocPolicy policy,
+                            const std::string& tag) {
+  *ptr = nullptr;
+  if (!reserve(size, true, tag)) {
+    return ACL_ERROR_BAD_ALLOC;
+  }
+  aclError ret = aclrtMalloc(ptr, size, policy);
+  if (ret == ACL_SUCCESS) {
+    add(*ptr, size, true, tag);
+  } else {
+    release(size, true, tag);
+  }
+  return ret;
+}
+
+aclError MemAccount::mallocHost(void** ptr, size_t size,
+                                const std::string& tag) {
+  *ptr = nullptr;
+  if (!reserve(size, false, tag)) {
+    return ACL_ERROR_BAD_ALLOC;
+  }
+  aclError ret = aclrtMallocHost(ptr, size);
+  if (ret == ACL_SUCCESS) {
+    add(*ptr, size, false, tag);
+  } else {
+    release(size, false, tag);
+  }
+  return ret;
+}
+
+aclError MemAccount::free(void* ptr) {
+  if (ptr == nullptr) {
+    return ACL_SUCCESS;
+  }
+  if (!remove(ptr, true)) {
+    ERROR_LOG("freeing untracked device buffer %p", ptr);
+  }
+  return aclrtFree(ptr);
+}
+
+aclError MemAccount::freeHost(void* ptr) {
+  if (ptr == nullptr) {
+    return ACL_SUCCESS;
+  }
+  if (!remove(ptr, false)) {
+    ERROR_LOG("freeing untracked host buffer %p", ptr);
+  }
+  return aclrtFreeHost(ptr);
+}
+
+void MemAccount::setBudget(size_t device_bytes, size_t host_bytes) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  device_budget_ = device_bytes;
+  host_budget_ = host_bytes;
+}
+
+bool MemAccount::fits(size_t device_bytes, size_t host_bytes) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return (device_budget_ == 0 ||
+          device_.current + device_bytes <= device_budget_) &&
+         (host_budget_ == 0 || host_.current + host_bytes <= host_budget_);
+}
+
+size_t MemAccount::deviceBytes() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return device_.current;
+}
+
+size_t MemAccount::hostBytes() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return host_.current;
+}
+
+std::vector<MemTagUsage> MemAccount::usage() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::vector<MemTagUsage> out;
+  for (int device = 1; device >= 0; --device) {
+    const std::map<std::string, Totals>& tags =
+        device ? device_tags_ : host_tags_;
+    for (std::map<std::string, Totals>::const_iterator it = tags.begin();
+         it != tags.end(); ++it) {
+      MemTagUsage u = {it->first, device == 1, it->second.current,
+                       it->second.peak};
+      out.push_back(u);
+    }
+  }
+  return out;
+}
+
+void MemAccount::report() const {
+  std::vector<MemTagUsage> tags = usage();
+  for (size_t i = 0; i < tags.size(); ++i) {
+    INFO_LOG("memory %-6s %-16s current %10zu peak %10zu bytes",
+             tags[i].device ? "device" : "host", tags[i].tag.c_str(),
+             tags[i].current, tags[i].peak);
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  INFO_LOG("memory device total current %zu peak %zu budget %zu bytes",
+           device_.current, device_.peak, device_budget_);
+  INFO_LOG("memory host   total current %zu peak %zu budget %zu bytes",
+           host_.current, host_.peak, host_budget_);
+}
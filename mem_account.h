@@ -0,0 +1,78 @@
+#pragma once
+
+#include <stddef.h>
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "acl.h"
+#include "common.h"
+
+struct MemTagUsage {
+  std::string tag;
+  bool device;
+  size_t current;
+  size_t peak;
+};
+
+// Accounting front for aclrtMalloc/aclrtMallocHost. Every buffer is tagged
+// with its owner (e.g. "backT/work", "head/output"); current and peak bytes
+// are kept per tag and per memory kind. With a budget set, allocations that
+// would exceed it are refused, and fits() lets callers turn away a new
+// model set or tracker up front instead of failing halfway through a run.
+class MemAccount {
+ public:
+  static MemAccount& instance();
+
+  aclError malloc(void** ptr, size_t size, aclrtMemMallocPolicy policy,
+                  const std::string& tag);
+  aclError mallocHost(void** ptr, size_t size, const std::string& tag);
+  aclError free(void* ptr);
+  aclError freeHost(void* ptr);
+
+  // 0 means unlimited
+  void setBudget(size_t device_bytes, size_t host_bytes);
+  // whether the extra bytes fit on top of what is allocated now
+  bool fits(size_t device_bytes, size_t host_bytes) const;
+
+  size_t deviceBytes() const;
+  size_t hostBytes() const;
+  std::vector<MemTagUsage> usage() const;
+  void report() const;
+
+ private:
+  MemAccount();
+
+  struct Allocation {
+    std::string tag;
+    size_t size;
+    bool device;
+  };
+  struct Totals {
+    size_t current;
+    size_t peak;
+  };
+
+  // charges size against the budget and the tag before the runtime is asked
+  // for it, so concurrent allocations cannot both pass the budget check;
+  // add() then ties the charge to the buffer, release() drops it if the
+  // runtime refused
+  bool reserve(size_t size, bool device, const std::string& tag);
+  void add(void* ptr, size_t size, bool device, const std::string& tag);
+  void release(size_t size, bool device, const std::string& tag);
+  bool remove(void* ptr, bool device);
+  // callers hold mutex_
+  void uncharge(size_t size, bool device, const std::string& tag);
+
+  mutable std::mutex mutex_;
+  std::unordered_map<void*, Allocation> allocations_;
+  std::map<std::string, Totals> device_tags_;
+  std::map<std::string, Totals> host_tags_;
+  Totals device_;
+  Totals host_;
+  size_t device_budget_;
+  size_t host_budget_;
+};
@@ -3,12 +3,11 @@
 #include <algorithm>
 #include <cmath>
 #include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <string>
 
 // ----------- config参数 -----------
-const int INSTANCE_SIZE = 255;
-const int EXEMPLAR_SIZE = 127;
 const int BASE_SIZE = 7;
 const int POINT_STRIDE = 16;
 const float CONTEXT_AMOUNT = 0.5f;
@@ -16,50 +15,73 @@ const float PENALTY_K = 0.15f;
 const float WINDOW_INFLUENCE = 0.455f;
 const float LR = 0.37f;
 
-std::tuple<cv::Mat, cv::Mat, cv::Mat, cv::Mat> corner2center(
-    const cv::Mat& delta) {
-  cv::Mat cx = (delta.row(0) + delta.row(2)) / 2;
-  cv::Mat cy = (delta.row(1) + delta.row(3)) / 2;
-  cv::Mat w = delta.row(2) - delta.row(0);
-  cv::Mat h = delta.row(3) - delta.row(1);
-  return std::make_tuple(cx, cy, w, h);
-}
-
 NanoTrack::NanoTrack::NanoTrack(const char* modelPath_1,
                                 const char* modelPath_2,
                                 const char* modelPath_3)
-    : g_modelPath_1(modelPath_1),
-      g_modelPath_2(modelPath_2),
-      g_modelPath_3(modelPath_3),
-      module_T127(modelPath_1),
-      module_X255(modelPath_2),
-      module_head(modelPath_3) {
+    : NanoTrack(std::make_shared<NanoTrackModels>(modelPath_1, modelPath_2,
+                                                  modelPath_3)) {}
+
+NanoTrack::NanoTrack(std::shared_ptr<NanoTrackModels> models)
+    : NanoTrack(std::make_shared<InferenceDispatcher>()) {
+  g_modelPath_1 = models->T_path.c_str();
+  g_modelPath_2 = models->X_path.c_str();
+  g_modelPath_3 = models->head_path.c_str();
+  models_ = models;
+  acl_target_ = std::make_shared<AclTarget>(models);
+  dispatcher_->addTarget(acl_target_);
+}
+
+NanoTrack::NanoTrack(std::shared_ptr<InferenceDispatcher> dispatcher)
+    : g_modelPath_1(nullptr),
+      g_modelPath_2(nullptr),
+      g_modelPath_3(nullptr),
+      dispatcher_(dispatcher),
+      frame_id_(0),
+      target_id_(0) {
   score_size = (INSTANCE_SIZE - EXEMPLAR_SIZE) / POINT_STRIDE + 1 + BASE_SIZE;
-  window = createHanningWindow();
+  window = create_hanning_window(score_size);
   cls_out_channels = 2;
   points = generate_points(POINT_STRIDE, score_size);
 }
 
 NanoTrack::~NanoTrack() {}
 
-void NanoTrack::initsource() {
-  Result ret;
-
-  ret = module_T127.backbone_initDatasets();
-  if (ret != SUCCESS) {
-    ERROR_LOG("module_T127.backbone_initDatasets failed ");
+Result NanoTrack::initsource() {
+  if (models_) {
+    return models_->initsource();
   }
-  ret = module_X255.backbone_initDatasets();
-  if (ret != SUCCESS) {
-    ERROR_LOG("module_X255.backbone_initDatasets failed ");
+  return SUCCESS;
+}
+
+Result NanoTrack::setModels(std::shared_ptr<NanoTrackModels> models) {
+  if (!acl_target_) {
+    ERROR_LOG("setModels on a tracker without ACL models");
+    return FAILED;
   }
-  ret = module_head.head_initDatasets();
-  if (ret != SUCCESS) {
-    ERROR_LOG("module_head.head_initDatasets failed ");
+  std::shared_ptr<NanoTrackModels> previous = models_;
+  acl_target_->setModels(models);
+  // the template feature belongs to the old backT; encoded into a fresh Mat
+  // so a failure leaves feature_T_ as it was
+  if (!z_crop_.empty()) {
+    cv::Mat feature_T;
+    if (dispatcher_->runBackbone(BACKBONE_T, z_crop_, feature_T) != SUCCESS) {
+      ERROR_LOG("re-encoding the template failed, keeping the previous models");
+      acl_target_->setModels(previous);
+      return FAILED;
+    }
+    feature_T_ = feature_T;
   }
+  models_ = models;
+  g_modelPath_1 = models_->T_path.c_str();
+  g_modelPath_2 = models_->X_path.c_str();
+  g_modelPath_3 = models_->head_path.c_str();
+  return SUCCESS;
 }
 
 void NanoTrack::init(const cv::Mat& img, const cv::Rect2f& bbox) {
+  frame_id_ = 0;
+  TRACE_CONTEXT(frame_id_, target_id_);
+  TRACE_SPAN("NanoTrack::init");
   center_pos = cv::Point2f(bbox.x + (bbox.width - 1) / 2.0f,
                            bbox.y + (bbox.height - 1) / 2.0f);
   size = cv::Size2f(bbox.width, bbox.height);
@@ -68,54 +90,204 @@ void NanoTrack::init(const cv::Mat& img, const cv::Rect2f& bbox) {
   float h_z = size.height + CONTEXT_AMOUNT * (size.width + size.height);
   int s_z = round(std::sqrt(w_z * h_z));
 
-  channel_average = mean(img);
+  {
+    TRACE_SPAN("mean");
+    channel_average = mean(img);
+  }
+
+  // may be a view into img, keep a copy for re-encoding on a model swap
+  z_crop_ = get_subwindow(img, center_pos, EXEMPLAR_SIZE, s_z, channel_average)
+                .clone();
+
+  if (dispatcher_->runBackbone(BACKBONE_T, z_crop_, feature_T_) != SUCCESS) {
+    ERROR_LOG("encoding the template failed");
+    return;
+  }
+
+  if (recorder_) {
+    RecordHeader header;
+    memset(&header, 0, sizeof(header));
+    header.kind = RECORD_INIT;
+    header.frame_id = frame_id_;
+    header.record_ns = Trace::nowNs();
+    header.target_id = target_id_;
+    header.frame_width = img.cols;
+    header.frame_height = img.rows;
+    header.center_x = center_pos.x;
+    header.center_y = center_pos.y;
+    header.width = size.width;
+    header.height = size.height;
+    for (int i = 0; i < 4; ++i) {
+      header.channel_average[i] = channel_average[i];
+    }
+    std::vector<RecordTensor> tensors;
+    if (recorder_->crops()) {
+      tensors.push_back(RecordTensor{"template", z_crop_});
+    }
+    tensors.push_back(RecordTensor{"feature_T", feature_T_});
+    recorder_->write(header, tensors);
+  }
+}
+
+Result NanoTrack::track(const cv::Mat& img, cv::Rect& track_bbox,
+                        float& track_score) {
+  FrameRegion region = {img, cv::Point2f(0, 0), 1.0f, img.size()};
+  return track(region, track_bbox, track_score);
+}
 
-  cv::Mat z_crop =
-      get_subwindow(img, center_pos, EXEMPLAR_SIZE, s_z, channel_average);
+cv::Rect2f NanoTrack::searchRegion() const {
+  float w_z = size.width + CONTEXT_AMOUNT * (size.width + size.height);
+  float h_z = size.height + CONTEXT_AMOUNT * (size.width + size.height);
+  float s_x = std::sqrt(w_z * h_z) * (INSTANCE_SIZE / (float)EXEMPLAR_SIZE);
+  float c = (round(s_x) + 1) / 2.0f;
+  return cv::Rect2f(std::floor(center_pos.x - c + 0.5f),
+                    std::floor(center_pos.y - c + 0.5f), round(s_x),
+                    round(s_x));
+}
 
-  result_T = module_T127.runBackbone(z_crop);
+TrackState NanoTrack::state() const {
+  TrackState state = {center_pos, size, frame_id_};
+  return state;
 }
 
-void NanoTrack::track(const cv::Mat& img, cv::Rect& track_bbox,
-                      float& track_score) {
+void NanoTrack::setState(const TrackState& state) {
+  center_pos = state.center_pos;
+  size = state.size;
+  frame_id_ = state.frame_id;
+}
+
+Result NanoTrack::track(const FrameRegion& region, cv::Rect& track_bbox,
+                        float& track_score) {
+  beginFrame();
+  // tags every span of the frame, down to the backbone/head and kernels
+  TRACE_CONTEXT(frame_id_, target_id_);
+  TRACE_SPAN("NanoTrack::track");
+  cv::Mat x_crop = searchCrop(region);
+  std::vector<cv::Mat> outputs;
+  if (dispatcher_->runBackbone(BACKBONE_X, x_crop, feature_X_) != SUCCESS ||
+      dispatcher_->runHead(feature_T_, feature_X_, outputs) != SUCCESS) {
+    ERROR_LOG("inference failed, frame %lld skipped",
+              static_cast<long long>(frame_id_));
+    hold(track_bbox, track_score);
+    return FAILED;
+  }
+  TrackState before = state();
+  update(outputs, region.frame_size, track_bbox, track_score);
+  if (recorder_) {
+    recordTrack(region, before, x_crop, outputs, track_bbox, track_score);
+  }
+  return SUCCESS;
+}
+
+void NanoTrack::beginFrame() { ++frame_id_; }
+
+void NanoTrack::searchWindow(const TrackState& state,
+                             const FrameRegion& region,
+                             cv::Point2f& region_pos, int& region_sz) {
+  const cv::Size2f& size = state.size;
   float w_z = size.width + CONTEXT_AMOUNT * (size.width + size.height);
   float h_z = size.height + CONTEXT_AMOUNT * (size.width + size.height);
   float s_z = std::sqrt(w_z * h_z);
-  float scale_z = EXEMPLAR_SIZE / s_z;
   float s_x = s_z * (INSTANCE_SIZE / (float)EXEMPLAR_SIZE);
 
-  cv::Mat x_crop = get_subwindow(img, center_pos, INSTANCE_SIZE, round(s_x),
-                                 channel_average);
-  result_X = module_X255.runBackbone(x_crop);
+  region_pos = (state.center_pos - region.offset) * region.scale;
+  region_sz = (region.scale == 1.0f) ? round(s_x)
+                                     : round(round(s_x) * region.scale);
+}
 
-  std::vector<cv::Mat> outputs;
-  module_head.runHead(outputs, result_T, result_X);
-  std::vector<float> score = convert_score(outputs[0]);
-  cv::Mat pred_bbox = convert_bbox(outputs[1], points);
+cv::Mat NanoTrack::searchCrop(const FrameRegion& region) const {
+  TRACE_SPAN("NanoTrack::searchCrop");
+  // crop in region coordinates; pixels outside region.img are outside the
+  // frame and get padded with channel_average like before
+  cv::Point2f region_pos;
+  int region_sz;
+  searchWindow(state(), region, region_pos, region_sz);
+  return get_subwindow(region.img, region_pos, INSTANCE_SIZE, region_sz,
+                       channel_average);
+}
 
-  auto change = [](float r) { return std::max(r, 1.0f / r); };
-  auto sz = [](float w, float h) {
-    float pad = (w + h) * 0.5f;
-    return std::sqrt((w + pad) * (h + pad));
-  };
-
-  std::vector<float> s_c, r_c, penalty, pscore;
-  for (int i = 0; i < pred_bbox.cols; ++i) {
-    float sc = change(sz(pred_bbox.at<float>(2, i), pred_bbox.at<float>(3, i)) /
-                      sz(size.width * scale_z, size.height * scale_z));
-    float rc = change((size.width / size.height) /
-                      (pred_bbox.at<float>(2, i) / pred_bbox.at<float>(3, i)));
-    s_c.push_back(sc);
-    r_c.push_back(rc);
-    penalty.push_back(std::exp(-(rc * sc - 1) * PENALTY_K));
-    pscore.push_back(penalty.back() * score[i]);
+void NanoTrack::recordTrack(const FrameRegion& region,
+                            const TrackState& before, const cv::Mat& x_crop,
+                            const std::vector<cv::Mat>& outputs,
+                            const cv::Rect& track_bbox, float track_score) {
+  TRACE_SPAN("NanoTrack::recordTrack");
+  cv::Point2f region_pos;
+  int region_sz;
+  searchWindow(before, region, region_pos, region_sz);
+
+  // the part of the window inside region.img, found as get_subwindow does;
+  // replay crops it at region_pos - (patch_x, patch_y), which is exact in
+  // float, so the crop comes out bit for bit
+  float c = (region_sz + 1) / 2.0f;
+  int x_min = int(std::floor(region_pos.x - c + 0.5f));
+  int y_min = int(std::floor(region_pos.y - c + 0.5f));
+  cv::Rect window(x_min, y_min, region_sz, region_sz);
+  cv::Rect inside = window & cv::Rect(0, 0, region.img.cols, region.img.rows);
+
+  RecordHeader header;
+  memset(&header, 0, sizeof(header));
+  header.kind = RECORD_TRACK;
+  header.frame_id = before.frame_id;
+  header.record_ns = Trace::nowNs();
+  header.target_id = target_id_;
+  header.frame_width = region.frame_size.width;
+  header.frame_height = region.frame_size.height;
+  header.region_size = region_sz;
+  header.region_x = region_pos.x;
+  header.region_y = region_pos.y;
+  header.patch_x = inside.x;
+  header.patch_y = inside.y;
+  header.center_x = before.center_pos.x;
+  header.center_y = before.center_pos.y;
+  header.width = before.size.width;
+  header.height = before.size.height;
+  for (int i = 0; i < 4; ++i) {
+    header.channel_average[i] = channel_average[i];
+  }
+  header.bbox[0] = track_bbox.x;
+  header.bbox[1] = track_bbox.y;
+  header.bbox[2] = track_bbox.width;
+  header.bbox[3] = track_bbox.height;
+  header.score = track_score;
+
+  std::vector<RecordTensor> tensors;
+  if (inside.area() > 0) {
+    tensors.push_back(RecordTensor{"patch", region.img(inside)});
+  }
+  if (recorder_->crops()) {
+    tensors.push_back(RecordTensor{"crop", x_crop});
+  }
+  tensors.push_back(RecordTensor{"feature_X", feature_X_});
+  for (size_t i = 0; i < outputs.size() && i < 2; ++i) {
+    tensors.push_back(RecordTensor{i == 0 ? "score" : "delta", outputs[i]});
   }
-  for (size_t i = 0; i < pscore.size(); ++i)
-    pscore[i] =
-        pscore[i] * (1 - WINDOW_INFLUENCE) + window[i] * WINDOW_INFLUENCE;
+  recorder_->write(header, tensors);
+}
+
+void NanoTrack::hold(cv::Rect& track_bbox, float& track_score) const {
+  // no prediction for this frame, report the unchanged target
+  track_bbox = cv::Rect(center_pos.x - size.width / 2,
+                        center_pos.y - size.height / 2, size.width,
+                        size.height);
+  track_score = 0;
+}
 
-  int best_idx =
-      std::max_element(pscore.begin(), pscore.end()) - pscore.begin();
+void NanoTrack::update(const std::vector<cv::Mat>& outputs,
+                       const cv::Size& frame_size, cv::Rect& track_bbox,
+                       float& track_score) {
+  TRACE_SPAN("NanoTrack::update");
+  // same scale as the crop, the state has not changed since searchCrop
+  float w_z = size.width + CONTEXT_AMOUNT * (size.width + size.height);
+  float h_z = size.height + CONTEXT_AMOUNT * (size.width + size.height);
+  float s_z = std::sqrt(w_z * h_z);
+  float scale_z = EXEMPLAR_SIZE / s_z;
+
+  std::vector<float> score = convert_score(outputs[0], cls_out_channels);
+  cv::Mat pred_bbox = convert_bbox(outputs[1], points);
+
+  std::vector<float> penalty;
+  int best_idx = apply_penalty(pred_bbox, score, window, size, scale_z,
+                               PENALTY_K, WINDOW_INFLUENCE, penalty);
   std::vector<float> bbox(4);
   for (int i = 0; i < 4; ++i) {
     bbox[i] = pred_bbox.at<float>(i, best_idx) / scale_z;
@@ -128,7 +300,7 @@ void NanoTrack::track(const cv::Mat& img, cv::Rect& track_bbox,
   float height = size.height * (1 - lr) + bbox[3] * lr;
 
   std::tie(cx, cy, width, height) =
-      bbox_clip(cx, cy, width, height, cv::Size(img.cols, img.rows));
+      bbox_clip(cx, cy, width, height, frame_size);
 
   center_pos = cv::Point2f(cx, cy);
   size = cv::Size2f(width, height);
@@ -140,116 +312,3 @@ void NanoTrack::track(const cv::Mat& img, cv::Rect& track_bbox,
   track_bbox = cv::Rect(out_bbox[0], out_bbox[1], out_bbox[2], out_bbox[3]);
   track_score = best_score;
 }
-
-std::vector<float> NanoTrack::createHanningWindow() {
-  cv::Mat hanning;
-  cv::createHanningWindow(hanning, cv::Size(score_size, score_size), CV_32F);
-  return std::vector<float>((float*)hanning.datastart, (float*)hanning.dataend);
-}
-
-cv::Mat NanoTrack::generate_points(int stride, int size) {
-  cv::Mat points(size * size, 2, CV_32F);
-  int idx = 0;
-  int ori = -(size / 2) * stride;
-  for (int y = 0; y < size; ++y)
-    for (int x = 0; x < size; ++x, ++idx) {
-      points.at<float>(idx, 0) = ori + stride * x;
-      points.at<float>(idx, 1) = ori + stride * y;
-    }
-  return points;
-}
-
-cv::Mat NanoTrack::get_subwindow(const cv::Mat& im, cv::Point2f pos,
-                                 int model_sz, int original_sz,
-                                 cv::Scalar avg_chans) {
-  int im_h = im.rows, im_w = im.cols;
-  float c = (original_sz + 1) / 2.0f;
-  float context_xmin = std::floor(pos.x - c + 0.5f);
-  float context_ymin = std::floor(pos.y - c + 0.5f);
-  float context_xmax = context_xmin + original_sz - 1;
-  float context_ymax = context_ymin + original_sz - 1;
-
-  int left_pad = int(std::max(0.f, -context_xmin));
-  int top_pad = int(std::max(0.f, -context_ymin));
-  int right_pad = int(std::max(0.f, context_xmax - im_w + 1));
-  int bottom_pad = int(std::max(0.f, context_ymax - im_h + 1));
-
-  context_xmin += left_pad;
-  context_xmax += left_pad;
-  context_ymin += top_pad;
-  context_ymax += top_pad;
-
-  cv::Mat te_im;
-  if (top_pad > 0 || bottom_pad > 0 || left_pad > 0 || right_pad > 0) {
-    te_im = cv::Mat::zeros(im_h + top_pad + bottom_pad,
-                           im_w + left_pad + right_pad, im.type());
-    im.copyTo(te_im(cv::Rect(left_pad, top_pad, im_w, im_h)));
-    if (top_pad > 0)
-      te_im(cv::Rect(left_pad, 0, im_w, top_pad)).setTo(avg_chans);
-    if (bottom_pad > 0)
-      te_im(cv::Rect(left_pad, im_h + top_pad, im_w, bottom_pad))
-          .setTo(avg_chans);
-    if (left_pad > 0)
-      te_im(cv::Rect(0, 0, left_pad, te_im.rows)).setTo(avg_chans);
-    if (right_pad > 0)
-      te_im(cv::Rect(im_w + left_pad, 0, right_pad, te_im.rows))
-          .setTo(avg_chans);
-  } else {
-    te_im = im;
-  }
-  cv::Mat im_patch = te_im(cv::Rect(int(context_xmin), int(context_ymin),
-                                    int(context_xmax - context_xmin + 1),
-                                    int(context_ymax - context_ymin + 1)));
-
-  if (model_sz != original_sz)
-    cv::resize(im_patch, im_patch, cv::Size(model_sz, model_sz));
-
-  return im_patch;
-}
-
-std::vector<float> NanoTrack::convert_score(const cv::Mat& score) {
-  cv::Mat s =
-      score.reshape(1, {cls_out_channels, score.size[2] * score.size[3]});
-  cv::Mat s_t;
-  cv::transpose(s, s_t);  // (N, C)
-  std::vector<float> out;
-  for (int i = 0; i < s_t.rows; ++i) {
-    float maxv = *std::max_element(s_t.ptr<float>(i),
-                                   s_t.ptr<float>(i) + cls_out_channels);
-    float sum = 0.0f;
-    std::vector<float> exps(cls_out_channels);
-    for (int j = 0; j < cls_out_channels; ++j) {
-      exps[j] = std::exp(s_t.at<float>(i, j) - maxv);
-      sum += exps[j];
-    }
-    out.push_back(exps[1] / sum);  // 取正类概率
-  }
-  return out;
-}
-
-cv::Mat NanoTrack::convert_bbox(const cv::Mat& delta, const cv::Mat& point) {
-  cv::Mat d = delta.reshape(1, {4, delta.size[2] * delta.size[3]});
-  cv::Mat d_out = d.clone();
-  for (int i = 0; i < d.cols; ++i) {
-    d_out.at<float>(0, i) = point.at<float>(i, 0) - d.at<float>(0, i);
-    d_out.at<float>(1, i) = point.at<float>(i, 1) - d.at<float>(1, i);
-    d_out.at<float>(2, i) = point.at<float>(i, 0) + d.at<float>(2, i);
-    d_out.at<float>(3, i) = point.at<float>(i, 1) + d.at<float>(3, i);
-  }
-  cv::Mat cx, cy, w, h;
-  std::tie(cx, cy, w, h) = corner2center(d_out);
-  cv::Mat out;
-  cv::vconcat(std::vector<cv::Mat>{cx, cy, w, h}, out);  // 4 x N
-  return out;
-}
-
-std::tuple<float, float, float, float> NanoTrack::bbox_clip(float cx, float cy,
-                                                            float width,
-                                                            float height,
-                                                            cv::Size boundary) {
-  cx = std::max(0.f, std::min(cx, (float)boundary.width));
-  cy = std::max(0.f, std::min(cy, (float)boundary.height));
-  width = std::max(10.f, std::min(width, (float)boundary.width));
-  height = std::max(10.f, std::min(height, (float)boundary.height));
-  return std::make_tuple(cx, cy, width, height);
-}
\ No newline at end of file
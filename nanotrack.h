@@ -11,34 +11,109 @@
 #include <fstream>
 #include <iostream>
 #include <map>
+#include <memory>
 #include <opencv2/opencv.hpp>
 #include <string>
 #include <vector>
 
 #include "acl.h"
-#include "backbone.h"
-#include "head.h"
+#include "acl_target.h"
+#include "dispatcher.h"
+#include "tensor_record.h"
+#include "trace.h"
+#include "track_kernels.h"
+
+// Decoded pixels covering (at least) the search window of a frame. Sources
+// that decode only part of the frame describe where img sits in the frame:
+// frame pixel (x, y) maps to img pixel ((x, y) - offset) * scale.
+struct FrameRegion {
+  cv::Mat img;
+  cv::Point2f offset;
+  float scale;
+  cv::Size frame_size;
+};
+
+// per-target state carried from frame to frame
+struct TrackState {
+  cv::Point2f center_pos;
+  cv::Size2f size;
+  int64_t frame_id;
+};
 
 class NanoTrack {
  public:
   NanoTrack(const char* Tback_model, const char* Xback_model,
             const char* Head_model);
+  // runs on the ACL models; more targets can be added through dispatcher()
+  NanoTrack(std::shared_ptr<NanoTrackModels> models);
+  // runs only on the dispatcher's targets, e.g. CPU-only
+  NanoTrack(std::shared_ptr<InferenceDispatcher> dispatcher);
   ~NanoTrack();
-  void initsource();
+  Result initsource();
+  // switches to models (datasets already initialised) and re-encodes the
+  // current template with the new backT; call between frames. FAILED if the
+  // template could not be re-encoded, the previous models stay in use then.
+  Result setModels(std::shared_ptr<NanoTrackModels> models);
 
   void init(const cv::Mat& img, const cv::Rect2f& bbox);
-  void track(const cv::Mat& img, cv::Rect& track_bbox, float& track_score);
+  // FAILED if inference failed; the box is then held (see hold())
+  Result track(const cv::Mat& img, cv::Rect& track_bbox, float& track_score);
+  Result track(const FrameRegion& region, cv::Rect& track_bbox,
+               float& track_score);
+  // frame area the next track() call will crop from
+  cv::Rect2f searchRegion() const;
+
+  // The stages of track(), for callers that batch the inference of many
+  // trackers (OfflineEngine): beginFrame, searchCrop, backX and the head on
+  // the crop with templateFeature(), then update with the head outputs, or
+  // hold if inference failed. beginFrame only advances the frame id; the
+  // caller opens the TRACE_CONTEXT for the stages it runs.
+  void beginFrame();
+  cv::Mat searchCrop(const FrameRegion& region) const;
+  const cv::Mat& templateFeature() const { return feature_T_; }
+  void update(const std::vector<cv::Mat>& outputs, const cv::Size& frame_size,
+              cv::Rect& track_bbox, float& track_score);
+  void hold(cv::Rect& track_bbox, float& track_score) const;
+
+  // lets callers roll back a track() whose input turned out to be invalid
+  TrackState state() const;
+  void setState(const TrackState& state);
+  InferenceDispatcher& dispatcher() const { return *dispatcher_; }
+  const std::shared_ptr<InferenceDispatcher>& sharedDispatcher() const {
+    return dispatcher_;
+  }
+  // id attached to this tracker's trace spans
+  void setTargetId(int32_t target_id) { target_id_ = target_id; }
+  // records every init() and successful track() (not the staged calls of
+  // OfflineEngine) for bench/replay; null stops recording
+  void setRecorder(std::shared_ptr<TensorRecorder> recorder) {
+    recorder_ = recorder;
+  }
 
   const char* g_modelPath_1;
   const char* g_modelPath_2;
   const char* g_modelPath_3;
 
  private:
-  Backbone module_T127;
-  Backbone module_X255;
-  Head module_head;
-  void* result_T;
-  void* result_X;
+  // search window of a target at state in region coordinates, as
+  // searchCrop cuts it
+  static void searchWindow(const TrackState& state, const FrameRegion& region,
+                           cv::Point2f& region_pos, int& region_sz);
+  // before is the state the search crop was cut at
+  void recordTrack(const FrameRegion& region, const TrackState& before,
+                   const cv::Mat& x_crop, const std::vector<cv::Mat>& outputs,
+                   const cv::Rect& track_bbox, float track_score);
+
+  std::shared_ptr<NanoTrackModels> models_;
+  std::shared_ptr<AclTarget> acl_target_;
+  std::shared_ptr<InferenceDispatcher> dispatcher_;
+  std::shared_ptr<TensorRecorder> recorder_;
+  cv::Mat z_crop_;  // template crop, kept to re-encode it on a model swap
+  cv::Mat feature_T_;
+  cv::Mat feature_X_;
+
+  int64_t frame_id_;
+  int32_t target_id_;
 
   cv::Point2f center_pos;
   cv::Size2f size;
@@ -46,14 +121,4 @@ class NanoTrack {
   int score_size, cls_out_channels;
   std::vector<float> window;
   cv::Mat points;
-
-  std::vector<float> createHanningWindow();
-  cv::Mat generate_points(int stride, int size);
-  cv::Mat get_subwindow(const cv::Mat& im, cv::Point2f pos, int model_sz,
-                        int original_sz, cv::Scalar avg_chans);
-  std::vector<float> convert_score(const cv::Mat& score);
-  cv::Mat convert_bbox(const cv::Mat& delta, const cv::Mat& point);
-  std::tuple<float, float, float, float> bbox_clip(float cx, float cy,
-                                                   float width, float height,
-                                                   cv::Size boundary);
 };
@@ -1,5 +1,7 @@
 #include "nanotrack_app.h"
 
+#include <stdlib.h>
+
 #include <fstream>
 #include <iostream>
 #include <opencv2/opencv.hpp>
@@ -8,10 +10,17 @@ NanoTrackApp::NanoTrackApp()
     : deviceId_(0),
       context_(nullptr),
       stream_(nullptr),
-      nanotrack_(nullptr) {
-    T_model_path_ = "/app/sd/nanotrack_fp32/backT.om";
-    X_model_path_ = "/app/sd/nanotrack_fp32/backX.om";
-    head_model_path_ = "/app/sd/nanotrack_fp32/head.om";
+      nanotrack_(nullptr),
+      reloading_(false),
+      reload_ready_(false),
+      cpu_only_(false) {
+    // NANOTRACK_MODEL_DIR=<dir> loads the models from elsewhere, e.g.
+    // weights/nanotrack_fp32 for a host run against acl_sim
+    const char* model_dir = getenv("NANOTRACK_MODEL_DIR");
+    std::string dir = model_dir != nullptr ? model_dir : "/app/sd/nanotrack_fp32";
+    T_model_path_ = dir + "/backT.om";
+    X_model_path_ = dir + "/backX.om";
+    head_model_path_ = dir + "/head.om";
 }
 
 NanoTrackApp::~NanoTrackApp() {
@@ -23,7 +32,36 @@ bool NanoTrackApp::fileExists(const std::string& path) {
     return f.good();
 }
 
-Result NanoTrackApp::initialize() {
+static size_t budgetFromEnv(const char* name) {
+    const char* value = getenv(name);
+    if (value == nullptr) {
+        return 0;
+    }
+    return static_cast<size_t>(strtoull(value, nullptr, 10)) << 20;
+}
+
+void NanoTrackApp::setMemoryBudget(size_t device_bytes, size_t host_bytes) {
+    MemAccount::instance().setBudget(device_bytes, host_bytes);
+}
+
+Result NanoTrackApp::admitModels(const std::string& T_model_path, const std::string& X_model_path,
+                                 const std::string& head_model_path) {
+    size_t device_bytes = 0;
+    if (NanoTrackModels::querySize(T_model_path, X_model_path, head_model_path,
+                                   device_bytes) != SUCCESS) {
+        return FAILED;
+    }
+    // IO buffers are only known once loaded and are small next to the model
+    // memory; the allocator still enforces the budget for them
+    if (!MemAccount::instance().fits(device_bytes, 0)) {
+        ERROR_LOG("models need %zu device bytes on top of %zu in use, over budget",
+                  device_bytes, MemAccount::instance().deviceBytes());
+        return FAILED;
+    }
+    return SUCCESS;
+}
+
+Result NanoTrackApp::initializeNpu() {
     aclError ret = aclInit(nullptr);
     if (ret != ACL_SUCCESS) return FAILED;
 
@@ -41,29 +79,314 @@ Result NanoTrackApp::initialize() {
         return FAILED;
     }
 
-    nanotrack_ = new NanoTrack(T_model_path_, X_model_path_, head_model_path_);
-    nanotrack_->initsource();
+    if (admitModels(T_model_path_, X_model_path_, head_model_path_) != SUCCESS) {
+        return FAILED;
+    }
+    nanotrack_ = new NanoTrack(T_model_path_.c_str(), X_model_path_.c_str(),
+                               head_model_path_.c_str());
+    if (nanotrack_->initsource() != SUCCESS) {
+        ERROR_LOG("model buffers could not be allocated");
+        return FAILED;
+    }
+
+    const char* fallback_dir = getenv("NANOTRACK_CPU_FALLBACK");
+    if (fallback_dir != nullptr) {
+        // NANOTRACK_FRAME_BUDGET_MS=<ms> sets the backX/head budgets from one per-frame budget
+        DispatchPolicy policy;
+        const char* frame_budget = getenv("NANOTRACK_FRAME_BUDGET_MS");
+        if (frame_budget != nullptr) {
+            policy.setFrameBudget(atof(frame_budget));
+        }
+        if (enableCpuFallback(fallback_dir, policy) != SUCCESS) {
+            return FAILED;
+        }
+    }
+
+    return SUCCESS;
+}
+
+Result NanoTrackApp::initialize() {
+    // NANOTRACK_TRACE_FILE=<path> records spans and writes them on deinitialize
+    const char* trace_path = getenv("NANOTRACK_TRACE_FILE");
+    if (trace_path != nullptr) {
+#ifdef NANOTRACK_TRACE
+        trace_path_ = trace_path;
+        Trace::enable(true);
+        TRACE_THREAD_NAME("track");
+#else
+        ERROR_LOG("built without NANOTRACK_TRACE, ignoring NANOTRACK_TRACE_FILE");
+#endif
+    }
+
+    size_t device_budget = budgetFromEnv("NANOTRACK_DEVICE_BUDGET_MB");
+    size_t host_budget = budgetFromEnv("NANOTRACK_HOST_BUDGET_MB");
+    if (device_budget != 0 || host_budget != 0) {
+        setMemoryBudget(device_budget, host_budget);
+    }
+
+    // NANOTRACK_CPU_ONLY=<weights dir> runs the ONNX models on the CPU and
+    // leaves ACL alone, for units without an NPU
+    const char* cpu_only_dir = getenv("NANOTRACK_CPU_ONLY");
+    if (cpu_only_dir != nullptr) {
+        std::shared_ptr<CpuTarget> cpu = loadCpuTarget(cpu_only_dir);
+        if (!cpu) {
+            return FAILED;
+        }
+        std::shared_ptr<InferenceDispatcher> dispatcher = std::make_shared<InferenceDispatcher>();
+        dispatcher->addTarget(cpu);
+        nanotrack_ = new NanoTrack(dispatcher);
+        cpu_only_ = true;
+    } else if (initializeNpu() != SUCCESS) {
+        return FAILED;
+    }
+
+    if (!workers_) {
+        workers_ = WorkerPool::fromEnv();
+    }
+
+    // NANOTRACK_RECORD=<path> captures every frame's tensors for bench/replay,
+    // NANOTRACK_RECORD_CROPS=0 leaves out the search/template crops
+    const char* record_path = getenv("NANOTRACK_RECORD");
+    if (record_path != nullptr) {
+        const char* crops = getenv("NANOTRACK_RECORD_CROPS");
+        std::shared_ptr<TensorRecorder> recorder = std::make_shared<TensorRecorder>(
+            record_path, crops == nullptr || atoi(crops) != 0);
+        if (!recorder->isOpen()) {
+            return FAILED;
+        }
+        nanotrack_->setRecorder(recorder);
+    }
 
     return SUCCESS;
 }
 
 void NanoTrackApp::init(const cv::Mat& frame, cv::Rect init_bbox) {
+    if (reload_ready_.load(std::memory_order_acquire)) {
+        swapModels();
+    }
     nanotrack_->init(frame, init_bbox);
+    results_.reset();
 }
 
 Result NanoTrackApp::track(const cv::Mat& frame, cv::Rect &track_bbox, float &track_score) {
+    return track(frame, Trace::nowNs(), track_bbox, track_score);
+}
+
+Result NanoTrackApp::track(const cv::Mat& frame, int64_t capture_ns, cv::Rect &track_bbox,
+                           float &track_score) {
+    FrameRegion region = {frame, cv::Point2f(0, 0), 1.0f, frame.size()};
+    return track(region, capture_ns, track_bbox, track_score);
+}
+
+Result NanoTrackApp::track(const FrameRegion& region, cv::Rect &track_bbox, float &track_score) {
+    return track(region, Trace::nowNs(), track_bbox, track_score);
+}
+
+Result NanoTrackApp::track(const FrameRegion& region, int64_t capture_ns, cv::Rect &track_bbox,
+                           float &track_score) {
+    Result ret = trackRegion(region, track_bbox, track_score);
+    results_.publish(nanotrack_->state().frame_id, track_bbox, track_score, capture_ns,
+                     ret != SUCCESS);
+    return ret;
+}
+
+Result NanoTrackApp::trackRegion(const FrameRegion& region, cv::Rect &track_bbox,
+                                 float &track_score) {
+    if (reload_ready_.load(std::memory_order_acquire)) {
+        swapModels();
+    }
     double t1 = cv::getTickCount();
-    nanotrack_->track(frame, track_bbox, track_score);
+    Result ret = nanotrack_->track(region, track_bbox, track_score);
     double t2 = cv::getTickCount();
     double ms = (t2 - t1) * 1000 / cv::getTickFrequency();
     std::cout << "Frame processed in " << ms << " ms\n";
 
     std::cout << "++++++++++++++++track_bbox: " << track_bbox << std::endl;
     std::cout << "++++++++++++++++track_score: " << track_score << std::endl;
+    return ret;
+}
+
+Result NanoTrackApp::track(const FrameRing& ring, uint64_t& last_seq, cv::Rect &track_bbox,
+                           float &track_score, TrackResultChannel* results) {
+    FrameSlot slot;
+    if (!ring.acquireLatest(last_seq, slot)) {
+        return FAILED;
+    }
+    TrackState before = nanotrack_->state();
+    FrameRegion region = {slot.img, cv::Point2f(0, 0), 1.0f, slot.img.size()};
+    Result ret = trackRegion(region, track_bbox, track_score);
+    if (!ring.stillValid(slot)) {
+        ERROR_LOG("frame %llu overwritten while tracking, dropped",
+                  static_cast<unsigned long long>(slot.seq));
+        nanotrack_->setState(before);
+        return FAILED;
+    }
+    last_seq = slot.seq;
+    results_.setChannel(results);
+    results_.publish(slot.seq, track_bbox, track_score, slot.capture_ns, ret != SUCCESS);
+    return ret;
+}
+
+cv::Rect2f NanoTrackApp::searchRegion() const {
+    return nanotrack_->searchRegion();
+}
+
+const ResultPublisher& NanoTrackApp::results() const {
+    return results_;
+}
+
+Result NanoTrackApp::reloadModels(const std::string& T_model_path, const std::string& X_model_path,
+                                  const std::string& head_model_path) {
+    if (nanotrack_ == nullptr) {
+        ERROR_LOG("reloadModels called before initialize");
+        return FAILED;
+    }
+    if (cpu_only_) {
+        ERROR_LOG("reloadModels swaps NPU models, not available in cpu-only mode");
+        return FAILED;
+    }
+    if (!fileExists(T_model_path) || !fileExists(X_model_path) || !fileExists(head_model_path)) {
+        std::cerr << "One or more model files not found.\n";
+        return FAILED;
+    }
+    bool expected = false;
+    if (!reloading_.compare_exchange_strong(expected, true)) {
+        ERROR_LOG("model reload already in progress");
+        return FAILED;
+    }
+    // old and new sets are both resident until the swap
+    if (admitModels(T_model_path, X_model_path, head_model_path) != SUCCESS) {
+        reloading_ = false;
+        return FAILED;
+    }
+    // the previous loader has finished (reloading_ was false), reap it
+    if (loader_.joinable()) {
+        loader_.join();
+    }
+    loader_ = std::thread(&NanoTrackApp::loadModels, this, T_model_path, X_model_path,
+                          head_model_path);
+    return SUCCESS;
+}
+
+bool NanoTrackApp::reloadInProgress() const {
+    return reloading_.load();
+}
+
+void NanoTrackApp::loadModels(std::string T_model_path, std::string X_model_path,
+                              std::string head_model_path) {
+    TRACE_THREAD_NAME("model_loader");
+    TRACE_SPAN("NanoTrackApp::loadModels");
+    // device memory and models belong to the context, not to the thread
+    aclError ret = aclrtSetCurrentContext(context_);
+    if (ret != ACL_SUCCESS) {
+        ERROR_LOG("set current context failed, errorCode is %d", ret);
+        reloading_ = false;
+        return;
+    }
+    INFO_LOG("loading models %s %s %s", T_model_path.c_str(), X_model_path.c_str(),
+             head_model_path.c_str());
+    std::shared_ptr<NanoTrackModels> models =
+        std::make_shared<NanoTrackModels>(T_model_path, X_model_path, head_model_path);
+    if (models->initsource() != SUCCESS) {
+        ERROR_LOG("model reload failed, keeping the current models");
+        reloading_ = false;
+        return;
+    }
+    std::lock_guard<std::mutex> lock(reload_mutex_);
+    pending_models_ = models;
+    reload_ready_.store(true, std::memory_order_release);
+}
+
+void NanoTrackApp::swapModels() {
+    TRACE_SPAN("NanoTrackApp::swapModels");
+    std::shared_ptr<NanoTrackModels> models;
+    {
+        std::lock_guard<std::mutex> lock(reload_mutex_);
+        models.swap(pending_models_);
+        reload_ready_.store(false, std::memory_order_relaxed);
+    }
+    // on success the old models are freed here unless someone else still
+    // holds them, on failure the new ones are once models goes out of scope
+    if (nanotrack_->setModels(models) != SUCCESS) {
+        ERROR_LOG("switching to models %s %s %s failed, keeping %s %s %s", models->T_path.c_str(),
+                  models->X_path.c_str(), models->head_path.c_str(), T_model_path_.c_str(),
+                  X_model_path_.c_str(), head_model_path_.c_str());
+        reloading_ = false;
+        return;
+    }
+    T_model_path_ = models->T_path;
+    X_model_path_ = models->X_path;
+    head_model_path_ = models->head_path;
+    reloading_ = false;
+    INFO_LOG("switched to models %s %s %s", T_model_path_.c_str(), X_model_path_.c_str(),
+             head_model_path_.c_str());
+}
+
+std::shared_ptr<CpuTarget> NanoTrackApp::loadCpuTarget(const std::string& weights_dir) {
+    std::shared_ptr<CpuTarget> cpu = std::make_shared<CpuTarget>(
+        "cpu", weights_dir + "/nanotrack_backbone127.onnx", weights_dir + "/nanotrack_backbone255.onnx",
+        weights_dir + "/nanotrack_head.onnx");
+    if (!cpu->loaded()) {
+        ERROR_LOG("cpu models not found in %s", weights_dir.c_str());
+        return nullptr;
+    }
+    return cpu;
+}
+
+Result NanoTrackApp::enableCpuFallback(const std::string& weights_dir,
+                                       const DispatchPolicy& policy) {
+    if (nanotrack_ == nullptr) {
+        ERROR_LOG("enableCpuFallback called before initialize");
+        return FAILED;
+    }
+    std::shared_ptr<CpuTarget> cpu = loadCpuTarget(weights_dir);
+    if (!cpu) {
+        return FAILED;
+    }
+    nanotrack_->dispatcher().setPolicy(policy);
+    nanotrack_->dispatcher().addTarget(cpu);
+    INFO_LOG("cpu fallback enabled, models from %s", weights_dir.c_str());
     return SUCCESS;
 }
 
+Result NanoTrackApp::runOffline(const std::vector<OfflineSequence>& sequences,
+                                const OfflinePolicy& policy,
+                                std::vector<OfflineSequenceResult>& results,
+                                OfflineStats* stats) {
+    if (nanotrack_ == nullptr) {
+        ERROR_LOG("runOffline called before initialize");
+        return FAILED;
+    }
+    OfflineEngine engine(nanotrack_->sharedDispatcher(), policy, workers_);
+    return engine.run(sequences, results, stats);
+}
+
+void NanoTrackApp::setWorkerPool(std::shared_ptr<WorkerPool> pool) {
+    workers_ = pool;
+}
+
+const InferenceDispatcher& NanoTrackApp::dispatcher() const {
+    return nanotrack_->dispatcher();
+}
+
 Result NanoTrackApp::deinitialize() {
+    if (nanotrack_ != nullptr) {
+        nanotrack_->dispatcher().printMetrics();
+        MemAccount::instance().report();
+        results_.printMetrics();
+    }
+    if (workers_) {
+        workers_->printStats();
+        workers_.reset();
+    }
+    if (loader_.joinable()) {
+        loader_.join();
+    }
+    {
+        std::lock_guard<std::mutex> lock(reload_mutex_);
+        pending_models_.reset();
+        reload_ready_ = false;
+    }
     delete nanotrack_;
     nanotrack_ = nullptr;
 
@@ -75,8 +398,17 @@ Result NanoTrackApp::deinitialize() {
         aclrtDestroyContext(context_);
         context_ = nullptr;
     }
-    aclrtResetDevice(deviceId_);
-    aclFinalize();
+    if (!cpu_only_) {
+        aclrtResetDevice(deviceId_);
+        aclFinalize();
+    }
+    cpu_only_ = false;
+
+    if (!trace_path_.empty()) {
+        Trace::enable(false);
+        Trace::exportJson(trace_path_);
+        trace_path_.clear();
+    }
 
     return SUCCESS;
 }
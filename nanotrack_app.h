@@ -1,8 +1,17 @@
 #pragma once
 
+#include <atomic>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
 #include "acl.h"
+#include "cpu_target.h"
+#include "frame_ring.h"
 #include "nanotrack.h"
+#include "offline_engine.h"
+#include "result_publisher.h"
+#include "worker_pool.h"
 
 class NanoTrackApp {
 public:
@@ -11,19 +20,92 @@ public:
 
     Result initialize();
     void init(const cv::Mat& frame, cv::Rect init_bbox);
+    // Every tracked frame is also published to results(). Without a capture
+    // timestamp the time of the call is used, which hides decode latency.
+    // FAILED if inference failed; the held box is published with
+    // TRACK_RESULT_HELD then.
     Result track(const cv::Mat& frame, cv::Rect &track_bbox, float &track_score);
+    Result track(const cv::Mat& frame, int64_t capture_ns, cv::Rect &track_bbox,
+                 float &track_score);
+    // partially decoded frame, see JpegSource::readRegion
+    Result track(const FrameRegion& region, cv::Rect &track_bbox, float &track_score);
+    Result track(const FrameRegion& region, int64_t capture_ns, cv::Rect &track_bbox,
+                 float &track_score);
+    cv::Rect2f searchRegion() const;
+    // latest result for the gimbal/flight-control loop, safe to poll from any
+    // thread at any rate
+    const ResultPublisher& results() const;
+    // Tracks the newest frame of ring newer than last_seq, cropping straight
+    // out of the shared slot, and also publishes the result to results if given.
+    // FAILED if there is no new frame or the producer overwrote the slot while
+    // it was read; the tracker state is then left unchanged. Also FAILED if
+    // inference failed, the frame then counts as consumed and is published as
+    // held.
+    Result track(const FrameRing& ring, uint64_t& last_seq, cv::Rect &track_bbox,
+                 float &track_score, TrackResultChannel* results = nullptr);
     Result deinitialize();
 
+    // Loads new backT/backX/head models on a background thread while the
+    // current ones keep tracking. The switch happens at the next init()/track()
+    // call, active templates are re-encoded with the new backT. Fails if a
+    // reload is still in progress.
+    Result reloadModels(const std::string& T_model_path, const std::string& X_model_path,
+                        const std::string& head_model_path);
+    bool reloadInProgress() const;
+
+    // Adds the ONNX models in weights_dir as a CPU target behind the NPU;
+    // backbone/head executions move there while the NPU would miss the
+    // policy's per-stage budget. Also enabled by NANOTRACK_CPU_FALLBACK=<dir>.
+    Result enableCpuFallback(const std::string& weights_dir,
+                             const DispatchPolicy& policy = DispatchPolicy());
+    const InferenceDispatcher& dispatcher() const;
+
+    // Device/host byte budgets for all ACL buffers, 0 for unlimited. Model
+    // sets that would not fit are refused by initialize() and reloadModels()
+    // before anything is loaded. Also set by NANOTRACK_DEVICE_BUDGET_MB and
+    // NANOTRACK_HOST_BUDGET_MB.
+    void setMemoryBudget(size_t device_bytes, size_t host_bytes);
+
+    // Tracks many independent clips interleaved, with backX/head batched
+    // across them on this app's targets (see OfflineEngine). Leaves the live
+    // tracker alone.
+    Result runOffline(const std::vector<OfflineSequence>& sequences, const OfflinePolicy& policy,
+                      std::vector<OfflineSequenceResult>& results, OfflineStats* stats = nullptr);
+    // CPU workers for the per-clip crops and updates of runOffline. The live
+    // track() stays on the calling thread. Also created by
+    // NANOTRACK_WORKER_CPUS=<cpu,...>, one worker pinned to each listed core.
+    void setWorkerPool(std::shared_ptr<WorkerPool> pool);
+
 private:
     bool fileExists(const std::string& path);
+    Result initializeNpu();
+    // null if the models are missing
+    static std::shared_ptr<CpuTarget> loadCpuTarget(const std::string& weights_dir);
+    void loadModels(std::string T_model_path, std::string X_model_path,
+                    std::string head_model_path);
+    void swapModels();
+    Result trackRegion(const FrameRegion& region, cv::Rect &track_bbox, float &track_score);
+    Result admitModels(const std::string& T_model_path, const std::string& X_model_path,
+                       const std::string& head_model_path);
 
-    const char* T_model_path_;
-    const char* X_model_path_;
-    const char* head_model_path_;
+    std::string T_model_path_;
+    std::string X_model_path_;
+    std::string head_model_path_;
 
     int32_t deviceId_;
     aclrtContext context_;
     aclrtStream stream_;
 
     NanoTrack* nanotrack_;
+
+    std::thread loader_;
+    std::mutex reload_mutex_;
+    std::shared_ptr<NanoTrackModels> pending_models_;
+    std::atomic<bool> reloading_;
+    std::atomic<bool> reload_ready_;
+    bool cpu_only_;
+
+    std::string trace_path_;
+    ResultPublisher results_;
+    std::shared_ptr<WorkerPool> workers_;
 };
@@ -0,0 +1,301 @@
+#include "offline_engine.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#include "jpeg_source.h"
+#include "nanotrack.h"
+#include "trace.h"
+
+OfflinePolicy::OfflinePolicy()
+    : max_batch(8), max_wait_ms(2.0), decode_workers(2), max_active(32) {}
+
+struct OfflineEngine::Lane {
+  size_t index;
+  const OfflineSequence* sequence;
+  OfflineSequenceResult* result;
+  std::unique_ptr<NanoTrack> tracker;
+  size_t next_frame;
+  // set by the scheduler before a decode request
+  cv::Rect2f search;
+  // set by the decoder
+  FrameRegion region;
+  bool decode_ok;
+};
+
+// hand-over between the scheduler and the decode workers
+struct OfflineEngine::Shared {
+  std::mutex mutex;
+  std::condition_variable decode_cv;
+  std::condition_variable ready_cv;
+  std::deque<Lane*> requests;
+  std::deque<Lane*> ready;
+  bool stop;
+};
+
+OfflineEngine::OfflineEngine(std::shared_ptr<InferenceDispatcher> dispatcher,
+                             const OfflinePolicy& policy,
+                             std::shared_ptr<WorkerPool> pool)
+    : dispatcher_(dispatcher), policy_(policy), pool_(pool) {
+  policy_.max_batch = std::max(policy_.max_batch, 1);
+  policy_.decode_workers = std::max(policy_.decode_workers, 1);
+}
+
+OfflineEngine::~OfflineEngine() {}
+
+void OfflineEngine::decodeLoop(Shared* shared) {
+  TRACE_THREAD_NAME("offline_decode");
+  JpegSource source;
+  for (;;) {
+    Lane* lane;
+    {
+      std::unique_lock<std::mutex> lock(shared->mutex);
+      shared->decode_cv.wait(
+          lock, [shared] { return shared->stop || !shared->requests.empty(); });
+      if (shared->requests.empty()) {
+        return;
+      }
+      lane = shared->requests.front();
+      shared->requests.pop_front();
+    }
+    const std::string& path = lane->sequence->frames[lane->next_frame];
+    bool ok;
+    if (lane->next_frame == 0) {
+      // the init frame is needed whole for the channel average
+      cv::Mat frame;
+      ok = source.read(path, frame) == SUCCESS;
+      FrameRegion region = {frame, cv::Point2f(0, 0), 1.0f, frame.size()};
+      lane->region = region;
+    } else {
+      ok = source.readRegion(path, lane->search, INSTANCE_SIZE,
+                             lane->region) == SUCCESS;
+    }
+    {
+      std::lock_guard<std::mutex> lock(shared->mutex);
+      lane->decode_ok = ok;
+      shared->ready.push_back(lane);
+    }
+    shared->ready_cv.notify_one();
+  }
+}
+
+void OfflineEngine::flush(const std::vector<Lane*>& batch,
+                          const std::vector<cv::Mat>& crops,
+                          OfflineStats& stats) {
+  TRACE_SPAN("OfflineEngine::flush");
+  std::vector<cv::Mat> features_T(batch.size());
+  for (size_t i = 0; i < batch.size(); ++i) {
+    features_T[i] = batch[i]->tracker->templateFeature();
+  }
+  std::vector<cv::Mat> features_X;
+  std::vector<std::vector<cv::Mat>> outputs;
+  bool ok =
+      dispatcher_->runBackboneBatch(BACKBONE_X, crops, features_X) ==
+          SUCCESS &&
+      dispatcher_->runHeadBatch(features_T, features_X, outputs) == SUCCESS;
+  if (!ok) {
+    ERROR_LOG("batch of %zu failed, frames reported unchanged", batch.size());
+  }
+  forEach(batch.size(), [&](size_t i) {
+    Lane* lane = batch[i];
+    TRACE_CONTEXT(static_cast<int64_t>(lane->next_frame),
+                  static_cast<int32_t>(lane->index));
+    cv::Rect box;
+    float score;
+    if (ok) {
+      lane->tracker->update(outputs[i], lane->region.frame_size, box, score);
+    } else {
+      lane->tracker->hold(box, score);
+    }
+    lane->result->boxes.push_back(box);
+    lane->result->scores.push_back(score);
+  });
+  stats.frames += batch.size();
+  stats.batches++;
+  stats.largest_batch =
+      std::max(stats.largest_batch, static_cast<int>(batch.size()));
+}
+
+void OfflineEngine::forEach(size_t count,
+                            const std::function<void(size_t)>& body) {
+  if (pool_) {
+    pool_->parallelFor(count, body);
+    return;
+  }
+  for (size_t i = 0; i < count; ++i) {
+    body(i);
+  }
+}
+
+Result OfflineEngine::run(const std::vector<OfflineSequence>& sequences,
+                          std::vector<OfflineSequenceResult>& results,
+                          OfflineStats* stats_out) {
+  TRACE_SPAN("OfflineEngine::run");
+  int64_t start_ns = Trace::nowNs();
+  OfflineStats stats = {0, 0, 0, 0, 0, 0, 0};
+  results.assign(sequences.size(), OfflineSequenceResult());
+  std::vector<std::unique_ptr<Lane>> lanes(sequences.size());
+
+  Shared shared;
+  shared.stop = false;
+  std::vector<std::thread> workers;
+  for (int i = 0; i < policy_.decode_workers; ++i) {
+    workers.push_back(std::thread(&OfflineEngine::decodeLoop, this, &shared));
+  }
+
+  size_t next_sequence = 0;
+  size_t active = 0;
+  auto request = [&](Lane* lane) {
+    {
+      std::lock_guard<std::mutex> lock(shared.mutex);
+      shared.requests.push_back(lane);
+    }
+    shared.decode_cv.notify_one();
+  };
+  auto admit = [&]() {
+    while (next_sequence < sequences.size() &&
+           (policy_.max_active <= 0 ||
+            active < static_cast<size_t>(policy_.max_active))) {
+      size_t index = next_sequence++;
+      results[index].ok = true;
+      if (sequences[index].frames.empty()) {
+        continue;
+      }
+      Lane* lane = new Lane();
+      lanes[index].reset(lane);
+      lane->index = index;
+      lane->sequence = &sequences[index];
+      lane->result = &results[index];
+      lane->tracker.reset(new NanoTrack(dispatcher_));
+      lane->tracker->setTargetId(static_cast<int32_t>(index));
+      lane->next_frame = 0;
+      ++active;
+      request(lane);
+    }
+  };
+  auto retire = [&](Lane* lane) {
+    // frees the tracker and the last decoded region
+    lanes[lane->index].reset();
+    --active;
+    admit();
+  };
+  auto advance = [&](Lane* lane) {
+    if (++lane->next_frame == lane->sequence->frames.size()) {
+      retire(lane);
+      return;
+    }
+    lane->search = lane->tracker->searchRegion();
+    request(lane);
+  };
+
+  std::vector<Lane*> batch;
+  std::vector<cv::Mat> crops;
+  uint64_t batched_frames = 0;
+  auto send = [&]() {
+    flush(batch, crops, stats);
+    batched_frames += batch.size();
+    std::vector<Lane*> done;
+    done.swap(batch);
+    crops.clear();
+    for (size_t i = 0; i < done.size(); ++i) {
+      advance(done[i]);
+    }
+  };
+
+  admit();
+  std::chrono::steady_clock::time_point deadline;
+  while (active > 0) {
+    std::deque<Lane*> ready;
+    {
+      std::unique_lock<std::mutex> lock(shared.mutex);
+      auto has_ready = [&shared] { return !shared.ready.empty(); };
+      if (batch.empty()) {
+        shared.ready_cv.wait(lock, has_ready);
+      } else if (batch.size() < active) {
+        shared.ready_cv.wait_until(lock, deadline, has_ready);
+      }
+      ready.swap(shared.ready);
+    }
+    std::vector<Lane*> searching;
+    for (size_t i = 0; i < ready.size(); ++i) {
+      Lane* lane = ready[i];
+      if (!lane->decode_ok) {
+        ERROR_LOG("decoding %s failed, sequence stopped",
+                  lane->sequence->frames[lane->next_frame].c_str());
+        lane->result->ok = false;
+        retire(lane);
+        continue;
+      }
+      if (lane->next_frame == 0) {
+        lane->tracker->init(lane->region.img, lane->sequence->init_bbox);
+        stats.frames++;
+        advance(lane);
+        continue;
+      }
+      searching.push_back(lane);
+    }
+    std::vector<cv::Mat> ready_crops(searching.size());
+    forEach(searching.size(), [&](size_t i) {
+      Lane* lane = searching[i];
+      TRACE_CONTEXT(static_cast<int64_t>(lane->next_frame),
+                    static_cast<int32_t>(lane->index));
+      lane->tracker->beginFrame();
+      ready_crops[i] = lane->tracker->searchCrop(lane->region);
+    });
+    for (size_t i = 0; i < searching.size(); ++i) {
+      crops.push_back(ready_crops[i]);
+      batch.push_back(searching[i]);
+      if (batch.size() == 1) {
+        deadline = std::chrono::steady_clock::now() +
+                   std::chrono::microseconds(
+                       static_cast<int64_t>(policy_.max_wait_ms * 1000));
+      }
+      if (batch.size() >= static_cast<size_t>(policy_.max_batch)) {
+        send();
+      }
+    }
+    // send a partial batch once nothing else can join it in time
+    if (!batch.empty() && (batch.size() == active ||
+                           std::chrono::steady_clock::now() >= deadline)) {
+      send();
+    }
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(shared.mutex);
+    shared.stop = true;
+  }
+  shared.decode_cv.notify_all();
+  for (size_t i = 0; i < workers.size(); ++i) {
+    workers[i].join();
+  }
+
+  stats.sequences = sequences.size();
+  stats.seconds = (Trace::nowNs() - start_ns) / 1e9;
+  stats.fps = stats.seconds > 0 ? stats.frames / stats.seconds : 0;
+  stats.mean_batch =
+      stats.batches ? double(batched_frames) / stats.batches : 0;
+  if (stats_out != nullptr) {
+    *stats_out = stats;
+  }
+  for (size_t i = 0; i < results.size(); ++i) {
+    if (!results[i].ok) {
+      return FAILED;
+    }
+  }
+  return SUCCESS;
+}
+
+void OfflineEngine::printStats(const OfflineStats& stats) {
+  INFO_LOG(
+      "offline: %llu sequences, %llu frames in %.2f s, %.1f fps, %llu "
+      "batches, mean batch %.2f, largest %d",
+      static_cast<unsigned long long>(stats.sequences),
+      static_cast<unsigned long long>(stats.frames), stats.seconds, stats.fps,
+      static_cast<unsigned long long>(stats.batches), stats.mean_batch,
+      stats.largest_batch);
+}
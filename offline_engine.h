@@ -0,0 +1,89 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <functional>
+#include <memory>
+#include <opencv2/core/core.hpp>
+#include <string>
+#include <vector>
+
+#include "dispatcher.h"
+#include "worker_pool.h"
+
+// one clip, tracked from frames[0] on
+struct OfflineSequence {
+  std::vector<std::string> frames;  // JPEG paths in order
+  cv::Rect init_bbox;               // target in frames[0]
+};
+
+struct OfflineSequenceResult {
+  // one entry per frame after the first
+  std::vector<cv::Rect> boxes;
+  std::vector<float> scores;
+  // false if a frame failed to decode; the results stop before it
+  bool ok;
+};
+
+struct OfflinePolicy {
+  OfflinePolicy();
+
+  // search crops per backX/head execution
+  int max_batch;
+  // how long a partial batch waits for more sequences to become ready
+  double max_wait_ms;
+  // JPEG decode threads
+  int decode_workers;
+  // sequences tracked at the same time, bounds memory; 0 for all of them
+  int max_active;
+};
+
+struct OfflineStats {
+  uint64_t sequences;
+  uint64_t frames;  // including the init frames
+  uint64_t batches;
+  int largest_batch;
+  double mean_batch;
+  double seconds;
+  double fps;
+};
+
+// Throughput mode for batches of independent clips. Every clip stays
+// strictly sequential, but many are tracked interleaved: decode workers
+// decode the next search region of each waiting clip, and the search crops
+// of all ready clips are gathered into one backX and one head execution of
+// up to max_batch crops. A partial batch is sent once max_wait_ms has passed
+// or no other clip can join it. Results are scattered back per clip.
+//
+// The live path (NanoTrack::track) is not involved; each clip gets its own
+// NanoTrack on the shared dispatcher. With a worker pool, the search crops
+// and the tracker updates of a batch run on it, one task per clip; each clip
+// is still touched by one task at a time, so results do not depend on it.
+class OfflineEngine {
+ public:
+  explicit OfflineEngine(std::shared_ptr<InferenceDispatcher> dispatcher,
+                         const OfflinePolicy& policy = OfflinePolicy(),
+                         std::shared_ptr<WorkerPool> pool = nullptr);
+  ~OfflineEngine();
+
+  Result run(const std::vector<OfflineSequence>& sequences,
+             std::vector<OfflineSequenceResult>& results,
+             OfflineStats* stats = nullptr);
+
+  static void printStats(const OfflineStats& stats);
+
+ private:
+  struct Lane;
+  struct Shared;
+
+  void decodeLoop(Shared* shared);
+  // backX + head for the batch, then each lane's tracker update
+  void flush(const std::vector<Lane*>& batch,
+             const std::vector<cv::Mat>& crops, OfflineStats& stats);
+  // body(0) .. body(count - 1), on the pool if there is one
+  void forEach(size_t count, const std::function<void(size_t)>& body);
+
+  std::shared_ptr<InferenceDispatcher> dispatcher_;
+  OfflinePolicy policy_;
+  std::shared_ptr<WorkerPool> pool_;
+};
@@ -0,0 +1,178 @@
+#include "onnx_info.h"
+
+#include <fstream>
+#include <iterator>
+#include <set>
+
+namespace {
+
+// protobuf field numbers, onnx.proto
+const int MODEL_GRAPH = 7;
+const int GRAPH_INITIALIZER = 5;
+const int GRAPH_INPUT = 11;
+const int GRAPH_OUTPUT = 12;
+const int TENSOR_NAME = 8;
+const int VALUE_INFO_NAME = 1;
+const int VALUE_INFO_TYPE = 2;
+const int TYPE_TENSOR = 1;
+const int TENSOR_TYPE_SHAPE = 2;
+const int SHAPE_DIM = 1;
+const int DIM_VALUE = 1;
+
+struct Field {
+  int number;
+  int wire_type;
+  uint64_t value;  // varint
+  const uint8_t* data;  // length-delimited
+  size_t size;
+};
+
+class Reader {
+ public:
+  Reader(const uint8_t* data, size_t size) : p_(data), end_(data + size) {}
+
+  // false at the end or on malformed input
+  bool next(Field& field) {
+    uint64_t key;
+    if (p_ >= end_ || !varint(key)) {
+      return false;
+    }
+    field.number = static_cast<int>(key >> 3);
+    field.wire_type = static_cast<int>(key & 7);
+    field.data = nullptr;
+    field.size = 0;
+    switch (field.wire_type) {
+      case 0:
+        return varint(field.value);
+      case 1:
+        return skip(8);
+      case 5:
+        return skip(4);
+      case 2: {
+        uint64_t size;
+        if (!varint(size) || size > static_cast<uint64_t>(end_ - p_)) {
+          return false;
+        }
+        field.data = p_;
+        field.size = size;
+        p_ += size;
+        return true;
+      }
+      default:
+        return false;
+    }
+  }
+
+ private:
+  bool varint(uint64_t& value) {
+    value = 0;
+    for (int shift = 0; shift < 64 && p_ < end_; shift += 7) {
+      uint8_t byte = *p_++;
+      value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+      if (!(byte & 0x80)) {
+        return true;
+      }
+    }
+    return false;
+  }
+  bool skip(size_t n) {
+    if (static_cast<size_t>(end_ - p_) < n) {
+      return false;
+    }
+    p_ += n;
+    return true;
+  }
+
+  const uint8_t* p_;
+  const uint8_t* end_;
+};
+
+// first length-delimited field with this number
+bool child(const Field& parent, int number, Field& out) {
+  Reader reader(parent.data, parent.size);
+  Field field;
+  while (reader.next(field)) {
+    if (field.number == number && field.wire_type == 2) {
+      out = field;
+      return true;
+    }
+  }
+  return false;
+}
+
+OnnxTensorInfo valueInfo(const Field& info) {
+  OnnxTensorInfo tensor;
+  Field name, type, tensor_type, shape;
+  if (child(info, VALUE_INFO_NAME, name)) {
+    tensor.name.assign(reinterpret_cast<const char*>(name.data), name.size);
+  }
+  if (child(info, VALUE_INFO_TYPE, type) &&
+      child(type, TYPE_TENSOR, tensor_type) &&
+      child(tensor_type, TENSOR_TYPE_SHAPE, shape)) {
+    Reader dims(shape.data, shape.size);
+    Field dim;
+    while (dims.next(dim)) {
+      if (dim.number != SHAPE_DIM || dim.wire_type != 2) {
+        continue;
+      }
+      int64_t value = 1;
+      bool fixed = false;
+      Reader dim_fields(dim.data, dim.size);
+      Field f;
+      while (dim_fields.next(f)) {
+        if (f.number == DIM_VALUE && f.wire_type == 0) {
+          value = static_cast<int64_t>(f.value);
+          fixed = true;
+        }
+      }
+      tensor.dims.push_back(value);
+      tensor.symbolic.push_back(!fixed);
+    }
+  }
+  return tensor;
+}
+
+}  // namespace
+
+bool readOnnxInfo(const std::string& path, std::vector<OnnxTensorInfo>& inputs,
+                  std::vector<OnnxTensorInfo>& outputs) {
+  std::ifstream file(path.c_str(), std::ios::binary);
+  if (!file) {
+    return false;
+  }
+  std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(file)),
+                             std::istreambuf_iterator<char>());
+  Field model = {0, 2, 0, bytes.data(), bytes.size()};
+  Field graph;
+  if (!child(model, MODEL_GRAPH, graph)) {
+    return false;
+  }
+  // older exporters list the weights among the graph inputs as well
+  std::set<std::string> initializers;
+  Reader reader(graph.data, graph.size);
+  Field field;
+  while (reader.next(field)) {
+    Field name;
+    if (field.number == GRAPH_INITIALIZER && child(field, TENSOR_NAME, name)) {
+      initializers.insert(
+          std::string(reinterpret_cast<const char*>(name.data), name.size));
+    }
+  }
+  inputs.clear();
+  outputs.clear();
+  Reader io(graph.data, graph.size);
+  while (io.next(field)) {
+    if (field.wire_type != 2) {
+      continue;
+    }
+    if (field.number == GRAPH_INPUT) {
+      OnnxTensorInfo tensor = valueInfo(field);
+      if (!initializers.count(tensor.name)) {
+        inputs.push_back(tensor);
+      }
+    } else if (field.number == GRAPH_OUTPUT) {
+      outputs.push_back(valueInfo(field));
+    }
+  }
+  return !inputs.empty() && !outputs.empty();
+}
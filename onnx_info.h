@@ -0,0 +1,18 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+struct OnnxTensorInfo {
+  std::string name;
+  std::vector<int64_t> dims;  // symbolic dimensions read as 1
+  std::vector<bool> symbolic;  // per dimension, no fixed size in the file
+};
+
+// Graph inputs (minus initializers) and outputs of an ONNX file, read
+// straight from the protobuf so no ONNX runtime is needed. Used by acl_sim
+// for the model shapes and by CpuTarget to see whether a model batches.
+bool readOnnxInfo(const std::string& path, std::vector<OnnxTensorInfo>& inputs,
+                  std::vector<OnnxTensorInfo>& outputs);
@@ -0,0 +1,119 @@
+#include "result_publisher.h"
+
+#include <algorithm>
+
+#include "common.h"
+#include "trace.h"
+
+static const int LATENCY_BUCKET_US = 100;
+static const int LATENCY_BUCKETS = 2000;  // 200 ms
+
+ResultPublisher::ResultPublisher(float velocity_alpha, double max_gap_ms)
+    : channel_(nullptr),
+      velocity_alpha_(velocity_alpha),
+      max_gap_ns_(static_cast<int64_t>(max_gap_ms * 1e6)),
+      have_prev_(false),
+      prev_capture_ns_(0),
+      histogram_(LATENCY_BUCKETS + 1, 0),
+      count_(0),
+      sum_ms_(0),
+      max_ms_(0) {}
+
+void ResultPublisher::setChannel(TrackResultChannel* channel) {
+  channel_ = channel;
+}
+
+void ResultPublisher::reset() { have_prev_ = false; }
+
+void ResultPublisher::publish(uint64_t frame_seq, const cv::Rect& bbox,
+                              float score, int64_t capture_ns, bool held) {
+  TRACE_SPAN("ResultPublisher::publish");
+  // a held box did not move, it would drag the velocity towards zero; the
+  // next tracked frame measures against the last tracked one instead
+  if (!held) {
+    cv::Point2f center(bbox.x + bbox.width * 0.5f,
+                       bbox.y + bbox.height * 0.5f);
+    int64_t dt_ns = capture_ns - prev_capture_ns_;
+    if (!have_prev_ || dt_ns <= 0 || dt_ns > max_gap_ns_) {
+      velocity_ = cv::Point2f(0, 0);
+    } else {
+      cv::Point2f measured = (center - prev_center_) * (1e9f / dt_ns);
+      velocity_ =
+          measured * velocity_alpha_ + velocity_ * (1 - velocity_alpha_);
+    }
+    have_prev_ = true;
+    prev_center_ = center;
+    prev_capture_ns_ = capture_ns;
+  }
+
+  SharedTrackResult result;
+  result.frame_seq = frame_seq;
+  result.x = bbox.x;
+  result.y = bbox.y;
+  result.width = bbox.width;
+  result.height = bbox.height;
+  result.score = score;
+  result.vx = velocity_.x;
+  result.vy = velocity_.y;
+  result.status = held ? TRACK_RESULT_HELD : TRACK_RESULT_TRACKED;
+  result.capture_ns = capture_ns;
+  result.publish_ns = Trace::nowNs();
+  cell_.write(result);
+  if (channel_ != nullptr) {
+    channel_->publish(result);
+  }
+
+  double ms = (result.publish_ns - capture_ns) * 1e-6;
+  int bucket = static_cast<int>(ms * 1000 / LATENCY_BUCKET_US);
+  bucket = std::max(0, std::min(bucket, LATENCY_BUCKETS));
+  std::lock_guard<std::mutex> lock(stats_mutex_);
+  ++histogram_[bucket];
+  ++count_;
+  sum_ms_ += ms;
+  max_ms_ = std::max(max_ms_, ms);
+}
+
+bool ResultPublisher::latest(SharedTrackResult& result) const {
+  if (cell_.version() == 0) {
+    return false;
+  }
+  cell_.read(result);
+  return true;
+}
+
+PublishLatencyStats ResultPublisher::latency() const {
+  std::lock_guard<std::mutex> lock(stats_mutex_);
+  PublishLatencyStats stats = {count_, 0, 0, 0, max_ms_};
+  if (count_ == 0) {
+    return stats;
+  }
+  stats.mean_ms = sum_ms_ / count_;
+  uint64_t p50_rank = (count_ + 1) / 2;
+  uint64_t p99_rank = count_ - count_ / 100;
+  uint64_t seen = 0;
+  bool have_p50 = false;
+  for (int i = 0; i <= LATENCY_BUCKETS; ++i) {
+    seen += histogram_[i];
+    // upper edge of the bucket, the open-ended one reports the max
+    double edge_ms =
+        i == LATENCY_BUCKETS ? max_ms_ : (i + 1) * LATENCY_BUCKET_US / 1000.0;
+    if (!have_p50 && seen >= p50_rank) {
+      stats.p50_ms = std::min(edge_ms, max_ms_);
+      have_p50 = true;
+    }
+    if (seen >= p99_rank) {
+      stats.p99_ms = std::min(edge_ms, max_ms_);
+      break;
+    }
+  }
+  return stats;
+}
+
+void ResultPublisher::printMetrics() const {
+  PublishLatencyStats stats = latency();
+  INFO_LOG(
+      "capture-to-publish latency: %llu results, mean %.2f ms, p50 %.2f ms, "
+      "p99 %.2f ms, max %.2f ms",
+      static_cast<unsigned long long>(stats.count), stats.mean_ms,
+      stats.p50_ms, stats.p99_ms, stats.max_ms);
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <mutex>
+#include <opencv2/core/core.hpp>
+#include <vector>
+
+#include "frame_ring.h"
+#include "seqlock.h"
+
+struct PublishLatencyStats {
+  uint64_t count;
+  double mean_ms;
+  double p50_ms;
+  double p99_ms;
+  double max_ms;
+};
+
+// Publishes tracking results for consumers running at their own rate (the
+// gimbal or flight-control loop). The latest result sits in a seqlock cell:
+// the tracker never waits on a reader and a reader never waits on the
+// tracker. Each result carries the frame's capture time, the publish time and
+// a smoothed centre velocity, so the consumer can extrapolate the box to its
+// own "now" with SharedTrackResult::extrapolate. Capture-to-publish latency
+// is collected per result.
+//
+// publish() and reset() must come from one thread (the tracker).
+class ResultPublisher {
+ public:
+  // velocity_alpha weighs the newest frame-to-frame velocity; frames further
+  // apart than max_gap_ms restart the estimate from zero
+  explicit ResultPublisher(float velocity_alpha = 0.5f,
+                           double max_gap_ms = 200.0);
+
+  // also mirror every result into a shared-memory channel, nullptr to stop
+  void setChannel(TrackResultChannel* channel);
+
+  // a held result (no prediction for the frame) is published with
+  // TRACK_RESULT_HELD and leaves the velocity estimate alone
+  void publish(uint64_t frame_seq, const cv::Rect& bbox, float score,
+               int64_t capture_ns, bool held = false);
+  // forget the velocity, e.g. after the tracker was re-initialised
+  void reset();
+
+  // false if nothing was published yet; never blocks the publisher
+  bool latest(SharedTrackResult& result) const;
+  uint32_t version() const { return cell_.version(); }
+
+  PublishLatencyStats latency() const;
+  void printMetrics() const;
+
+ private:
+  Seqlock<SharedTrackResult> cell_;
+  TrackResultChannel* channel_;
+  float velocity_alpha_;
+  int64_t max_gap_ns_;
+
+  bool have_prev_;
+  cv::Point2f prev_center_;
+  int64_t prev_capture_ns_;
+  cv::Point2f velocity_;
+
+  // latency histogram in LATENCY_BUCKET_US buckets, last one open-ended
+  mutable std::mutex stats_mutex_;
+  std::vector<uint64_t> histogram_;
+  uint64_t count_;
+  double sum_ms_;
+  double max_ms_;
+};
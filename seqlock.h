@@ -0,0 +1,51 @@
+#pragma once
+
+#include <string.h>
+
+#include <atomic>
+#include <type_traits>
+
+// Single-writer latest-value cell. The writer never waits; readers retry if
+// they raced a write. Only holds a lock-free atomic and T, so it also works
+// placed in shared memory between processes. T must be trivially copyable.
+template <typename T>
+class Seqlock {
+  static_assert(std::is_trivially_copyable<T>::value,
+                "Seqlock payload must be trivially copyable");
+
+ public:
+  Seqlock() : seq_(0) { memset(&value_, 0, sizeof(value_)); }
+
+  void write(const T& value) {
+    uint32_t seq = seq_.load(std::memory_order_relaxed);
+    seq_.store(seq + 1, std::memory_order_relaxed);  // odd: write in progress
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(&value_, &value, sizeof(T));
+    seq_.store(seq + 2, std::memory_order_release);
+  }
+
+  // false if a write was in progress; value is then unspecified
+  bool tryRead(T& value) const {
+    uint32_t before = seq_.load(std::memory_order_acquire);
+    if (before & 1) {
+      return false;
+    }
+    memcpy(&value, &value_, sizeof(T));
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return seq_.load(std::memory_order_relaxed) == before;
+  }
+
+  void read(T& value) const {
+    while (!tryRead(value)) {
+    }
+  }
+
+  // number of completed writes
+  uint32_t version() const {
+    return seq_.load(std::memory_order_acquire) / 2;
+  }
+
+ private:
+  std::atomic<uint32_t> seq_;
+  T value_;
+};
@@ -0,0 +1,195 @@
+#include "tensor_record.h"
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static size_t alignUp(size_t bytes) {
+  return (bytes + RECORD_ALIGN - 1) / RECORD_ALIGN * RECORD_ALIGN;
+}
+
+TensorRecorder::TensorRecorder(const std::string& path, bool crops)
+    : file_(fopen(path.c_str(), "wb")), crops_(crops), records_(0) {
+  if (file_ == nullptr) {
+    ERROR_LOG("cannot create capture file %s", path.c_str());
+    return;
+  }
+  RecordFileHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, RECORD_MAGIC, sizeof(header.magic));
+  header.version = RECORD_VERSION;
+  header.record_header_size = sizeof(RecordHeader);
+  if (!writePadded(&header, sizeof(header))) {
+    fclose(file_);
+    file_ = nullptr;
+  }
+}
+
+TensorRecorder::~TensorRecorder() {
+  if (file_ != nullptr) {
+    fclose(file_);
+    INFO_LOG("recorded %llu frames",
+             static_cast<unsigned long long>(records_));
+  }
+}
+
+bool TensorRecorder::writePadded(const void* data, size_t bytes) {
+  static const char zeros[RECORD_ALIGN] = {0};
+  size_t padding = alignUp(bytes) - bytes;
+  return fwrite(data, 1, bytes, file_) == bytes &&
+         fwrite(zeros, 1, padding, file_) == padding;
+}
+
+void TensorRecorder::write(RecordHeader header,
+                           const std::vector<RecordTensor>& tensors) {
+  std::vector<cv::Mat> mats;
+  std::vector<TensorHeader> headers;
+  for (size_t i = 0; i < tensors.size(); ++i) {
+    const cv::Mat& mat = tensors[i].mat;
+    if (mat.empty()) {
+      continue;
+    }
+    if (mat.dims > 4) {
+      ERROR_LOG("tensor %s has %d dims, not recorded", tensors[i].name,
+                mat.dims);
+      continue;
+    }
+    TensorHeader th;
+    memset(&th, 0, sizeof(th));
+    strncpy(th.name, tensors[i].name, sizeof(th.name) - 1);
+    th.type = mat.type();
+    th.dims = mat.dims;
+    for (int d = 0; d < mat.dims; ++d) {
+      th.shape[d] = mat.size[d];
+    }
+    th.bytes = mat.total() * mat.elemSize();
+    headers.push_back(th);
+    // crops may be views into the frame
+    mats.push_back(mat.isContinuous() ? mat : mat.clone());
+  }
+  header.tensor_count = static_cast<uint32_t>(headers.size());
+  header.size = alignUp(sizeof(RecordHeader));
+  for (size_t i = 0; i < headers.size(); ++i) {
+    header.size += alignUp(sizeof(TensorHeader)) + alignUp(headers[i].bytes);
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (file_ == nullptr) {
+    return;
+  }
+  bool ok = writePadded(&header, sizeof(header));
+  for (size_t i = 0; ok && i < headers.size(); ++i) {
+    ok = writePadded(&headers[i], sizeof(headers[i])) &&
+         writePadded(mats[i].data, headers[i].bytes);
+  }
+  if (!ok) {
+    // a partial record at the end is dropped by the reader
+    ERROR_LOG("writing the capture file failed, recording stopped");
+    fclose(file_);
+    file_ = nullptr;
+    return;
+  }
+  records_++;
+}
+
+uint64_t TensorRecorder::records() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return records_;
+}
+
+TensorRecordReader::TensorRecordReader() : data_(nullptr), bytes_(0) {}
+
+TensorRecordReader::~TensorRecordReader() { close(); }
+
+void TensorRecordReader::close() {
+  if (data_ != nullptr) {
+    munmap(const_cast<unsigned char*>(data_), bytes_);
+    data_ = nullptr;
+  }
+  bytes_ = 0;
+  records_.clear();
+}
+
+Result TensorRecordReader::open(const std::string& path) {
+  close();
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    ERROR_LOG("cannot open capture file %s", path.c_str());
+    return FAILED;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(RecordFileHeader)) {
+    ERROR_LOG("%s is not a capture file", path.c_str());
+    ::close(fd);
+    return FAILED;
+  }
+  void* mapped = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (mapped == MAP_FAILED) {
+    ERROR_LOG("cannot map %s", path.c_str());
+    return FAILED;
+  }
+  data_ = static_cast<const unsigned char*>(mapped);
+  bytes_ = st.st_size;
+
+  const RecordFileHeader* file_header =
+      reinterpret_cast<const RecordFileHeader*>(data_);
+  if (memcmp(file_header->magic, RECORD_MAGIC, sizeof(RECORD_MAGIC)) != 0 ||
+      file_header->version != RECORD_VERSION ||
+      file_header->record_header_size != sizeof(RecordHeader)) {
+    ERROR_LOG("%s: not a capture file of this version", path.c_str());
+    close();
+    return FAILED;
+  }
+  size_t offset = alignUp(sizeof(RecordFileHeader));
+  while (offset + sizeof(RecordHeader) <= bytes_) {
+    const RecordHeader* header =
+        reinterpret_cast<const RecordHeader*>(data_ + offset);
+    if (header->size < alignUp(sizeof(RecordHeader)) ||
+        header->size % RECORD_ALIGN != 0 || header->size > bytes_ - offset) {
+      break;
+    }
+    records_.push_back(offset);
+    offset += header->size;
+  }
+  if (offset != bytes_) {
+    ERROR_LOG("%s: %zu trailing bytes ignored (truncated capture?)",
+              path.c_str(), bytes_ - offset);
+  }
+  return SUCCESS;
+}
+
+const RecordHeader& TensorRecordReader::header(size_t index) const {
+  return *reinterpret_cast<const RecordHeader*>(data_ + records_[index]);
+}
+
+cv::Mat TensorRecordReader::tensor(size_t index, const char* name) const {
+  const RecordHeader& record = header(index);
+  size_t offset = records_[index] + alignUp(sizeof(RecordHeader));
+  size_t end = records_[index] + record.size;
+  for (uint32_t i = 0; i < record.tensor_count; ++i) {
+    if (offset + alignUp(sizeof(TensorHeader)) > end) {
+      break;
+    }
+    const TensorHeader* th =
+        reinterpret_cast<const TensorHeader*>(data_ + offset);
+    offset += alignUp(sizeof(TensorHeader));
+    if (th->bytes > end - offset) {
+      break;
+    }
+    if (strncmp(th->name, name, sizeof(th->name)) == 0 && th->dims >= 1 &&
+        th->dims <= 4) {
+      cv::Mat mat(th->dims, th->shape, th->type,
+                  const_cast<unsigned char*>(data_ + offset));
+      if (mat.total() * mat.elemSize() != th->bytes) {
+        ERROR_LOG("record %zu: tensor %s has a bad size", index, name);
+        return cv::Mat();
+      }
+      return mat;
+    }
+    offset += alignUp(th->bytes);
+  }
+  return cv::Mat();
+}
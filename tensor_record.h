@@ -0,0 +1,124 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <mutex>
+#include <opencv2/core/core.hpp>
+#include <string>
+#include <vector>
+
+#include "common.h"
+
+// Capture files of the tracker's per-frame inputs and outputs, written by
+// TensorRecorder (NANOTRACK_RECORD=<path>) and replayed without models by
+// bench/replay. The layout is plain structs at 64-byte aligned offsets so a
+// reader can mmap the file and use the tensors in place:
+//
+//   RecordFileHeader, then per record: RecordHeader, then tensor_count times
+//   a TensorHeader followed by its data
+//
+// every part padded to a multiple of 64 bytes. Values are in the writer's
+// byte order.
+
+const char RECORD_MAGIC[8] = {'N', 'T', 'R', 'E', 'C', '\0', '\0', '\0'};
+const uint32_t RECORD_VERSION = 1;
+const size_t RECORD_ALIGN = 64;
+
+enum RecordKind { RECORD_INIT = 1, RECORD_TRACK = 2 };
+
+struct RecordFileHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t record_header_size;  // sizeof(RecordHeader) of the writer
+};
+
+// Frame quantities are in frame pixels, region quantities in pixels of the
+// decoded region (see FrameRegion).
+struct RecordHeader {
+  uint32_t kind;
+  uint32_t tensor_count;
+  uint64_t size;  // the whole record, multiple of RECORD_ALIGN
+  int64_t frame_id;
+  int64_t record_ns;
+  int32_t target_id;
+  int32_t frame_width;
+  int32_t frame_height;
+  // search window as passed to get_subwindow; the "patch" tensor holds the
+  // part of it inside the region, its top-left pixel at (patch_x, patch_y)
+  int32_t region_size;
+  float region_x;
+  float region_y;
+  int32_t patch_x;
+  int32_t patch_y;
+  // tracker state before the frame; for RECORD_INIT the target box centre
+  // and size
+  float center_x;
+  float center_y;
+  float width;
+  float height;
+  double channel_average[4];
+  // tracker output
+  int32_t bbox[4];
+  float score;
+  uint32_t reserved;
+};
+
+struct TensorHeader {
+  char name[16];
+  int32_t type;  // cv::Mat type
+  int32_t dims;
+  int32_t shape[4];
+  uint64_t bytes;
+};
+
+// a tensor to write; empty mats are skipped
+struct RecordTensor {
+  const char* name;
+  cv::Mat mat;
+};
+
+// Appends records to a capture file. write() copies the tensors into the
+// stdio buffer on the calling thread; at a few hundred KB per frame that is
+// cheap next to inference but not free, so only record while capturing.
+// Safe to share between trackers.
+class TensorRecorder {
+ public:
+  // crops=false leaves out the 255x255 search crop and the template crop,
+  // replay then cannot check the crop bit for bit
+  TensorRecorder(const std::string& path, bool crops);
+  ~TensorRecorder();
+
+  bool isOpen() const { return file_ != nullptr; }
+  bool crops() const { return crops_; }
+  void write(RecordHeader header, const std::vector<RecordTensor>& tensors);
+  uint64_t records() const;
+
+ private:
+  bool writePadded(const void* data, size_t bytes);
+
+  mutable std::mutex mutex_;
+  FILE* file_;
+  bool crops_;
+  uint64_t records_;
+};
+
+// Maps a capture file read-only. Tensors are views into the mapping and stay
+// valid as long as the reader.
+class TensorRecordReader {
+ public:
+  TensorRecordReader();
+  ~TensorRecordReader();
+
+  Result open(const std::string& path);
+  size_t size() const { return records_.size(); }
+  const RecordHeader& header(size_t index) const;
+  // empty if the record has no such tensor; do not write into it
+  cv::Mat tensor(size_t index, const char* name) const;
+
+ private:
+  void close();
+
+  const unsigned char* data_;
+  size_t bytes_;
+  std::vector<size_t> records_;  // offsets of the RecordHeaders
+};
@@ -0,0 +1,138 @@
+#include "trace.h"
+
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// spans per thread; a full buffer drops further spans and counts them
+static const uint32_t TRACE_BUFFER_EVENTS = 1 << 16;
+
+struct TraceBuffer {
+  std::atomic<uint32_t> count;
+  std::atomic<uint32_t> dropped;
+  int tid;
+  std::string thread_name;
+  // allocated by the first recorded span, so threads that only name
+  // themselves (or run with tracing off) do not pay for it; only read once
+  // count says it holds events
+  std::unique_ptr<TraceEvent[]> events;
+};
+
+// buffers outlive their threads so spans of finished threads still export
+static std::mutex g_registry_mutex;
+static std::vector<std::unique_ptr<TraceBuffer>> g_registry;
+
+static thread_local TraceBuffer* t_buffer = nullptr;
+static thread_local int64_t t_frame_id = -1;
+static thread_local int32_t t_target_id = -1;
+
+std::atomic<bool> Trace::enabled_(false);
+
+static TraceBuffer* threadBuffer() {
+  if (t_buffer == nullptr) {
+    std::unique_ptr<TraceBuffer> buffer(new TraceBuffer());
+    buffer->count = 0;
+    buffer->dropped = 0;
+    buffer->tid = static_cast<int>(syscall(SYS_gettid));
+    std::lock_guard<std::mutex> lock(g_registry_mutex);
+    t_buffer = buffer.get();
+    g_registry.push_back(std::move(buffer));
+  }
+  return t_buffer;
+}
+
+void Trace::enable(bool on) { enabled_.store(on, std::memory_order_relaxed); }
+
+int64_t Trace::nowNs() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<int64_t>(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+}
+
+void Trace::setThreadName(const char* name) {
+  TraceBuffer* buffer = threadBuffer();
+  std::lock_guard<std::mutex> lock(g_registry_mutex);
+  buffer->thread_name = name;
+}
+
+void Trace::setContext(int64_t frame_id, int32_t target_id) {
+  t_frame_id = frame_id;
+  t_target_id = target_id;
+}
+
+void Trace::getContext(int64_t& frame_id, int32_t& target_id) {
+  frame_id = t_frame_id;
+  target_id = t_target_id;
+}
+
+void Trace::record(const char* name, int64_t start_ns, int64_t end_ns) {
+  TraceBuffer* buffer = threadBuffer();
+  uint32_t n = buffer->count.load(std::memory_order_relaxed);
+  if (n >= TRACE_BUFFER_EVENTS) {
+    buffer->dropped.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  if (!buffer->events) {
+    buffer->events.reset(new TraceEvent[TRACE_BUFFER_EVENTS]);
+  }
+  TraceEvent& ev = buffer->events[n];
+  ev.name = name;
+  ev.start_ns = start_ns;
+  ev.dur_ns = end_ns - start_ns;
+  ev.frame_id = t_frame_id;
+  ev.target_id = t_target_id;
+  // publishes the event to exportJson
+  buffer->count.store(n + 1, std::memory_order_release);
+}
+
+Result Trace::exportJson(const std::string& path) {
+  std::ofstream out(path);
+  if (!out.good()) {
+    ERROR_LOG("open trace file failed, file is %s", path.c_str());
+    return FAILED;
+  }
+  int pid = static_cast<int>(getpid());
+  char line[512];
+  bool first = true;
+  uint32_t dropped = 0;
+  out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+  std::lock_guard<std::mutex> lock(g_registry_mutex);
+  for (size_t b = 0; b < g_registry.size(); ++b) {
+    const TraceBuffer& buffer = *g_registry[b];
+    if (!buffer.thread_name.empty()) {
+      snprintf(line, sizeof(line),
+               "%s{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":%d,"
+               "\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+               first ? "" : ",\n", pid, buffer.tid,
+               buffer.thread_name.c_str());
+      out << line;
+      first = false;
+    }
+    uint32_t n = buffer.count.load(std::memory_order_acquire);
+    for (uint32_t i = 0; i < n; ++i) {
+      const TraceEvent& ev = buffer.events[i];
+      // trace-event timestamps are microseconds
+      snprintf(line, sizeof(line),
+               "%s{\"ph\":\"X\",\"name\":\"%s\",\"pid\":%d,\"tid\":%d,"
+               "\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"frame\":%lld,"
+               "\"target\":%d}}",
+               first ? "" : ",\n", ev.name, pid, buffer.tid,
+               ev.start_ns / 1000.0, ev.dur_ns / 1000.0,
+               static_cast<long long>(ev.frame_id), ev.target_id);
+      out << line;
+      first = false;
+    }
+    dropped += buffer.dropped.load(std::memory_order_relaxed);
+  }
+  out << "\n]}\n";
+  if (dropped > 0) {
+    ERROR_LOG("trace buffers full, %u spans dropped", dropped);
+  }
+  INFO_LOG("trace written to %s", path.c_str());
+  return out.good() ? SUCCESS : FAILED;
+}
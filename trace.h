@@ -0,0 +1,90 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+#include <string>
+
+#include "common.h"
+
+// Span tracing exported as Chrome trace-event JSON (chrome://tracing or
+// ui.perfetto.dev). The TRACE_* macros compile to nothing unless the build
+// defines NANOTRACK_TRACE; when compiled in, spans are only recorded after
+// Trace::enable(true). Every thread records into its own fixed-size buffer
+// that only it writes, so recording a span never takes a lock.
+
+struct TraceEvent {
+  const char* name;  // string literal
+  int64_t start_ns;
+  int64_t dur_ns;
+  int64_t frame_id;
+  int32_t target_id;
+};
+
+class Trace {
+ public:
+  static void enable(bool on);
+  static bool enabled() { return enabled_.load(std::memory_order_relaxed); }
+  static int64_t nowNs();
+
+  // shown as the thread name in the viewer
+  static void setThreadName(const char* name);
+  // frame/target tags attached to spans of the calling thread
+  static void setContext(int64_t frame_id, int32_t target_id);
+  static void getContext(int64_t& frame_id, int32_t& target_id);
+
+  static void record(const char* name, int64_t start_ns, int64_t end_ns);
+  // writes every span recorded so far, safe while other threads record
+  static Result exportJson(const std::string& path);
+
+ private:
+  static std::atomic<bool> enabled_;
+};
+
+class TraceSpan {
+ public:
+  explicit TraceSpan(const char* name)
+      : name_(name), start_ns_(Trace::enabled() ? Trace::nowNs() : -1) {}
+  ~TraceSpan() {
+    if (start_ns_ >= 0) {
+      Trace::record(name_, start_ns_, Trace::nowNs());
+    }
+  }
+
+ private:
+  const char* name_;
+  int64_t start_ns_;
+};
+
+// sets the frame/target tags for the enclosing scope
+class TraceContext {
+ public:
+  TraceContext(int64_t frame_id, int32_t target_id) {
+    Trace::getContext(frame_id_, target_id_);
+    Trace::setContext(frame_id, target_id);
+  }
+  ~TraceContext() { Trace::setContext(frame_id_, target_id_); }
+
+ private:
+  int64_t frame_id_;
+  int32_t target_id_;
+};
+
+#ifdef NANOTRACK_TRACE
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SPAN(name) TraceSpan TRACE_CONCAT(trace_span_, __LINE__)(name)
+#define TRACE_CONTEXT(frame_id, target_id) \
+  TraceContext TRACE_CONCAT(trace_context_, __LINE__)(frame_id, target_id)
+#define TRACE_THREAD_NAME(name) Trace::setThreadName(name)
+#else
+#define TRACE_SPAN(name) \
+  do {                   \
+  } while (0)
+#define TRACE_CONTEXT(frame_id, target_id) \
+  do {                                     \
+  } while (0)
+#define TRACE_THREAD_NAME(name) \
+  do {                          \
+  } while (0)
+#endif
@@ -0,0 +1,166 @@
+#include "track_kernels.h"
+
+#include <algorithm>
+#include <cmath>
+
+std::tuple<cv::Mat, cv::Mat, cv::Mat, cv::Mat> corner2center(
+    const cv::Mat& delta) {
+  cv::Mat cx = (delta.row(0) + delta.row(2)) / 2;
+  cv::Mat cy = (delta.row(1) + delta.row(3)) / 2;
+  cv::Mat w = delta.row(2) - delta.row(0);
+  cv::Mat h = delta.row(3) - delta.row(1);
+  return std::make_tuple(cx, cy, w, h);
+}
+
+std::vector<float> create_hanning_window(int score_size) {
+  cv::Mat hanning;
+  cv::createHanningWindow(hanning, cv::Size(score_size, score_size), CV_32F);
+  return std::vector<float>((float*)hanning.datastart, (float*)hanning.dataend);
+}
+
+cv::Mat generate_points(int stride, int size) {
+  cv::Mat points(size * size, 2, CV_32F);
+  int idx = 0;
+  int ori = -(size / 2) * stride;
+  for (int y = 0; y < size; ++y)
+    for (int x = 0; x < size; ++x, ++idx) {
+      points.at<float>(idx, 0) = ori + stride * x;
+      points.at<float>(idx, 1) = ori + stride * y;
+    }
+  return points;
+}
+
+cv::Mat get_subwindow(const cv::Mat& im, cv::Point2f pos, int model_sz,
+                      int original_sz, cv::Scalar avg_chans) {
+  TRACE_SPAN("get_subwindow");
+  int im_h = im.rows, im_w = im.cols;
+  float c = (original_sz + 1) / 2.0f;
+  float context_xmin = std::floor(pos.x - c + 0.5f);
+  float context_ymin = std::floor(pos.y - c + 0.5f);
+  float context_xmax = context_xmin + original_sz - 1;
+  float context_ymax = context_ymin + original_sz - 1;
+
+  int left_pad = int(std::max(0.f, -context_xmin));
+  int top_pad = int(std::max(0.f, -context_ymin));
+  int right_pad = int(std::max(0.f, context_xmax - im_w + 1));
+  int bottom_pad = int(std::max(0.f, context_ymax - im_h + 1));
+
+  cv::Mat im_patch;
+  if (top_pad > 0 || bottom_pad > 0 || left_pad > 0 || right_pad > 0) {
+    // copy only the part of the window inside the frame and pad around it,
+    // not the whole frame (which may sit in shared memory, see FrameRing)
+    int x0 = int(context_xmin) + left_pad, y0 = int(context_ymin) + top_pad;
+    int x1 = int(context_xmax) - right_pad, y1 = int(context_ymax) - bottom_pad;
+    if (x0 > x1 || y0 > y1) {
+      im_patch = cv::Mat(original_sz, original_sz, im.type(), avg_chans);
+    } else {
+      cv::copyMakeBorder(im(cv::Rect(x0, y0, x1 - x0 + 1, y1 - y0 + 1)),
+                         im_patch, top_pad, bottom_pad, left_pad, right_pad,
+                         cv::BORDER_CONSTANT, avg_chans);
+    }
+  } else {
+    im_patch = im(cv::Rect(int(context_xmin), int(context_ymin),
+                           int(context_xmax - context_xmin + 1),
+                           int(context_ymax - context_ymin + 1)));
+  }
+
+  if (model_sz != original_sz)
+    cv::resize(im_patch, im_patch, cv::Size(model_sz, model_sz));
+
+  return im_patch;
+}
+
+void hwc_to_nchw(const cv::Mat& img, float* dst) {
+  int32_t channel = img.channels();
+  int32_t Height = img.rows;
+  int32_t Weight = img.cols;
+
+  // 图像转换为字节，从 HWC 到 NCHW
+  for (int h = 0; h < Height; ++h) {
+    for (int w = 0; w < Weight; ++w) {
+      for (int c = 0; c < channel; ++c) {
+        // 将像素值从 cv::Vec3b (即 uint8_t) 转换为 float
+        dst[c * Height * Weight + h * Weight + w] =
+            static_cast<float>(img.at<cv::Vec3b>(h, w)[c]);
+      }
+    }
+  }
+}
+
+std::vector<float> convert_score(const cv::Mat& score, int cls_out_channels) {
+  TRACE_SPAN("convert_score");
+  cv::Mat s =
+      score.reshape(1, {cls_out_channels, score.size[2] * score.size[3]});
+  cv::Mat s_t;
+  cv::transpose(s, s_t);  // (N, C)
+  std::vector<float> out;
+  for (int i = 0; i < s_t.rows; ++i) {
+    float maxv = *std::max_element(s_t.ptr<float>(i),
+                                   s_t.ptr<float>(i) + cls_out_channels);
+    float sum = 0.0f;
+    std::vector<float> exps(cls_out_channels);
+    for (int j = 0; j < cls_out_channels; ++j) {
+      exps[j] = std::exp(s_t.at<float>(i, j) - maxv);
+      sum += exps[j];
+    }
+    out.push_back(exps[1] / sum);  // 取正类概率
+  }
+  return out;
+}
+
+cv::Mat convert_bbox(const cv::Mat& delta, const cv::Mat& point) {
+  TRACE_SPAN("convert_bbox");
+  cv::Mat d = delta.reshape(1, {4, delta.size[2] * delta.size[3]});
+  cv::Mat d_out = d.clone();
+  for (int i = 0; i < d.cols; ++i) {
+    d_out.at<float>(0, i) = point.at<float>(i, 0) - d.at<float>(0, i);
+    d_out.at<float>(1, i) = point.at<float>(i, 1) - d.at<float>(1, i);
+    d_out.at<float>(2, i) = point.at<float>(i, 0) + d.at<float>(2, i);
+    d_out.at<float>(3, i) = point.at<float>(i, 1) + d.at<float>(3, i);
+  }
+  cv::Mat cx, cy, w, h;
+  std::tie(cx, cy, w, h) = corner2center(d_out);
+  cv::Mat out;
+  cv::vconcat(std::vector<cv::Mat>{cx, cy, w, h}, out);  // 4 x N
+  return out;
+}
+
+int apply_penalty(const cv::Mat& pred_bbox, const std::vector<float>& score,
+                  const std::vector<float>& window, cv::Size2f size,
+                  float scale_z, float penalty_k, float window_influence,
+                  std::vector<float>& penalty) {
+  TRACE_SPAN("penalty");
+  auto change = [](float r) { return std::max(r, 1.0f / r); };
+  auto sz = [](float w, float h) {
+    float pad = (w + h) * 0.5f;
+    return std::sqrt((w + pad) * (h + pad));
+  };
+
+  std::vector<float> s_c, r_c, pscore;
+  penalty.clear();
+  for (int i = 0; i < pred_bbox.cols; ++i) {
+    float sc = change(sz(pred_bbox.at<float>(2, i), pred_bbox.at<float>(3, i)) /
+                      sz(size.width * scale_z, size.height * scale_z));
+    float rc = change((size.width / size.height) /
+                      (pred_bbox.at<float>(2, i) / pred_bbox.at<float>(3, i)));
+    s_c.push_back(sc);
+    r_c.push_back(rc);
+    penalty.push_back(std::exp(-(rc * sc - 1) * penalty_k));
+    pscore.push_back(penalty.back() * score[i]);
+  }
+  for (size_t i = 0; i < pscore.size(); ++i)
+    pscore[i] =
+        pscore[i] * (1 - window_influence) + window[i] * window_influence;
+
+  return std::max_element(pscore.begin(), pscore.end()) - pscore.begin();
+}
+
+std::tuple<float, float, float, float> bbox_clip(float cx, float cy,
+                                                 float width, float height,
+                                                 cv::Size boundary) {
+  cx = std::max(0.f, std::min(cx, (float)boundary.width));
+  cy = std::max(0.f, std::min(cy, (float)boundary.height));
+  width = std::max(10.f, std::min(width, (float)boundary.width));
+  height = std::max(10.f, std::min(height, (float)boundary.height));
+  return std::make_tuple(cx, cy, width, height);
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <tuple>
+#include <vector>
+
+#include "trace.h"
+
+// CPU pre/postprocessing stages of NanoTrack. Kept free of ACL so they can be
+// benchmarked and replayed without a device (see bench/).
+
+// model input sizes of the search (backX) and template (backT) crops
+const int INSTANCE_SIZE = 255;
+const int EXEMPLAR_SIZE = 127;
+
+std::tuple<cv::Mat, cv::Mat, cv::Mat, cv::Mat> corner2center(
+    const cv::Mat& delta);
+std::vector<float> create_hanning_window(int score_size);
+cv::Mat generate_points(int stride, int size);
+
+// original_sz x original_sz window around pos resized to model_sz, pixels
+// outside im are filled with avg_chans. May return a view into im.
+cv::Mat get_subwindow(const cv::Mat& im, cv::Point2f pos, int model_sz,
+                      int original_sz, cv::Scalar avg_chans);
+// BGR uint8 HWC image -> float NCHW (N = 1), dst holds 3 * rows * cols floats
+void hwc_to_nchw(const cv::Mat& img, float* dst);
+
+// head outputs -> positive-class probability per anchor point
+std::vector<float> convert_score(const cv::Mat& score, int cls_out_channels);
+// head outputs -> 4 x N (cx, cy, w, h) relative to the search crop centre
+cv::Mat convert_bbox(const cv::Mat& delta, const cv::Mat& point);
+// scale/ratio change penalty plus cosine window, returns the best anchor
+// index and leaves the per-anchor penalty in penalty
+int apply_penalty(const cv::Mat& pred_bbox, const std::vector<float>& score,
+                  const std::vector<float>& window, cv::Size2f size,
+                  float scale_z, float penalty_k, float window_influence,
+                  std::vector<float>& penalty);
+std::tuple<float, float, float, float> bbox_clip(float cx, float cy,
+                                                 float width, float height,
+                                                 cv::Size boundary);
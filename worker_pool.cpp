@@ -0,0 +1,253 @@
+#include "worker_pool.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sstream>
+#include <string>
+
+#include "trace.h"
+
+struct WorkerPool::Worker {
+  int cpu;
+  std::thread thread;
+  std::mutex mutex;
+  std::deque<Task> queue;
+  std::atomic<uint64_t> tasks;
+  std::atomic<uint64_t> steals;
+  std::atomic<int64_t> busy_ns;
+};
+
+// the pool and worker index of the calling thread, if it is a worker
+static thread_local const WorkerPool* t_pool = nullptr;
+static thread_local int t_worker = -1;
+
+WorkerPool::WorkerPool(const std::vector<int>& cpus, size_t queue_capacity)
+    : queue_capacity_(queue_capacity == 0 ? 1 : queue_capacity),
+      start_ns_(Trace::nowNs()),
+      next_worker_(0),
+      inline_runs_(0),
+      queued_(0),
+      stop_(false) {
+  for (size_t i = 0; i < cpus.size(); ++i) {
+    std::unique_ptr<Worker> worker(new Worker());
+    worker->cpu = cpus[i];
+    worker->tasks = 0;
+    worker->steals = 0;
+    worker->busy_ns = 0;
+    workers_.push_back(std::move(worker));
+  }
+  // start only once workers_ is complete, they steal from each other
+  for (size_t i = 0; i < workers_.size(); ++i) {
+    Worker& worker = *workers_[i];
+    worker.thread = std::thread(&WorkerPool::workerLoop, this, i);
+    if (worker.cpu < 0) {
+      continue;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(worker.cpu, &set);
+    int ret = pthread_setaffinity_np(worker.thread.native_handle(),
+                                     sizeof(set), &set);
+    if (ret != 0) {
+      ERROR_LOG("pinning worker %zu to cpu %d failed: %s", i, worker.cpu,
+                strerror(ret));
+    }
+  }
+}
+
+WorkerPool::~WorkerPool() {
+  {
+    std::lock_guard<std::mutex> lock(idle_mutex_);
+    stop_ = true;
+  }
+  idle_cv_.notify_all();
+  for (size_t i = 0; i < workers_.size(); ++i) {
+    workers_[i]->thread.join();
+  }
+}
+
+std::shared_ptr<WorkerPool> WorkerPool::fromEnv() {
+  const char* value = getenv("NANOTRACK_WORKER_CPUS");
+  if (value == nullptr) {
+    return std::shared_ptr<WorkerPool>();
+  }
+  std::vector<int> cpus;
+  std::stringstream items(value);
+  std::string item;
+  while (std::getline(items, item, ',')) {
+    char* end;
+    long cpu = strtol(item.c_str(), &end, 10);
+    if (item.empty() || *end != '\0' || cpu < -1 || cpu >= CPU_SETSIZE) {
+      ERROR_LOG("NANOTRACK_WORKER_CPUS: bad cpu '%s', no worker pool",
+                item.c_str());
+      return std::shared_ptr<WorkerPool>();
+    }
+    cpus.push_back(static_cast<int>(cpu));
+  }
+  if (cpus.empty()) {
+    return std::shared_ptr<WorkerPool>();
+  }
+  return std::make_shared<WorkerPool>(cpus);
+}
+
+void WorkerPool::submit(TaskGroup& group, std::function<void()> task) {
+  group.pending_.fetch_add(1);
+  Task queued = {task, &group};
+  if (!workers_.empty()) {
+    // a worker keeps what it spawns, others spread round-robin
+    size_t index = (t_pool == this)
+                       ? static_cast<size_t>(t_worker)
+                       : next_worker_.fetch_add(1) % workers_.size();
+    Worker& worker = *workers_[index];
+    bool pushed = false;
+    {
+      std::lock_guard<std::mutex> lock(worker.mutex);
+      if (worker.queue.size() < queue_capacity_) {
+        worker.queue.push_back(queued);
+        pushed = true;
+      }
+    }
+    if (pushed) {
+      {
+        // pairs with the predicate check in workerLoop, no lost wake-up
+        std::lock_guard<std::mutex> lock(idle_mutex_);
+        queued_.fetch_add(1);
+      }
+      idle_cv_.notify_one();
+      return;
+    }
+  }
+  inline_runs_.fetch_add(1);
+  runTask(queued);
+}
+
+void WorkerPool::wait(TaskGroup& group) {
+  int self = (t_pool == this) ? t_worker : -1;
+  Task task;
+  bool stolen;
+  while (group.pending_.load() > 0 && takeTask(self, task, stolen)) {
+    runTask(task);
+  }
+  // The rest is running on workers. pending_ only drops under the group
+  // mutex and the last task notifies before unlocking, so seeing 0 under
+  // the mutex means no worker touches the group any more and the caller may
+  // destroy it. A 0 seen without the mutex proves nothing.
+  std::unique_lock<std::mutex> lock(group.mutex_);
+  group.done_cv_.wait(lock, [&group] { return group.pending_.load() == 0; });
+}
+
+void WorkerPool::parallelFor(size_t count,
+                             const std::function<void(size_t)>& body) {
+  if (count == 0) {
+    return;
+  }
+  TaskGroup group;
+  // the caller takes the first item itself
+  for (size_t i = 1; i < count; ++i) {
+    submit(group, [&body, i] { body(i); });
+  }
+  body(0);
+  wait(group);
+}
+
+bool WorkerPool::takeTask(int self, Task& task, bool& stolen) {
+  size_t n = workers_.size();
+  if (self >= 0) {
+    Worker& own = *workers_[self];
+    std::lock_guard<std::mutex> lock(own.mutex);
+    if (!own.queue.empty()) {
+      task = own.queue.back();
+      own.queue.pop_back();
+      queued_.fetch_sub(1);
+      stolen = false;
+      return true;
+    }
+  }
+  size_t first = self >= 0 ? static_cast<size_t>(self) + 1 : 0;
+  for (size_t k = 0; k < n; ++k) {
+    size_t index = (first + k) % n;
+    if (static_cast<int>(index) == self) {
+      continue;
+    }
+    Worker& victim = *workers_[index];
+    std::lock_guard<std::mutex> lock(victim.mutex);
+    if (!victim.queue.empty()) {
+      task = victim.queue.front();
+      victim.queue.pop_front();
+      queued_.fetch_sub(1);
+      stolen = true;
+      return true;
+    }
+  }
+  return false;
+}
+
+void WorkerPool::runTask(Task& task) {
+  task.run();
+  // the group may be destroyed as soon as wait() sees pending_ reach 0, so
+  // decrement and notify while holding its mutex, which wait() takes to
+  // check; nothing touches the group after the unlock
+  TaskGroup* group = task.group;
+  std::lock_guard<std::mutex> lock(group->mutex_);
+  if (group->pending_.fetch_sub(1) == 1) {
+    group->done_cv_.notify_all();
+  }
+}
+
+void WorkerPool::workerLoop(size_t index) {
+  TRACE_THREAD_NAME("worker");
+  t_pool = this;
+  t_worker = static_cast<int>(index);
+  Worker& self = *workers_[index];
+  for (;;) {
+    Task task;
+    bool stolen;
+    if (takeTask(t_worker, task, stolen)) {
+      int64_t start_ns = Trace::nowNs();
+      runTask(task);
+      self.busy_ns.fetch_add(Trace::nowNs() - start_ns);
+      self.tasks.fetch_add(1);
+      if (stolen) {
+        self.steals.fetch_add(1);
+      }
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(idle_mutex_);
+    idle_cv_.wait(lock, [this] { return stop_ || queued_.load() > 0; });
+    if (stop_ && queued_.load() == 0) {
+      return;
+    }
+  }
+}
+
+std::vector<WorkerStats> WorkerPool::stats() const {
+  double lifetime_ms = (Trace::nowNs() - start_ns_) / 1e6;
+  std::vector<WorkerStats> stats;
+  for (size_t i = 0; i < workers_.size(); ++i) {
+    const Worker& worker = *workers_[i];
+    WorkerStats s;
+    s.cpu = worker.cpu;
+    s.tasks = worker.tasks.load();
+    s.steals = worker.steals.load();
+    s.busy_ms = worker.busy_ns.load() / 1e6;
+    s.utilization = lifetime_ms > 0 ? s.busy_ms / lifetime_ms : 0;
+    stats.push_back(s);
+  }
+  return stats;
+}
+
+void WorkerPool::printStats() const {
+  std::vector<WorkerStats> all = stats();
+  for (size_t i = 0; i < all.size(); ++i) {
+    INFO_LOG("worker %zu cpu %d: %llu tasks (%llu stolen), busy %.1f ms, "
+             "%.1f%% utilized",
+             i, all[i].cpu, static_cast<unsigned long long>(all[i].tasks),
+             static_cast<unsigned long long>(all[i].steals), all[i].busy_ms,
+             100 * all[i].utilization);
+  }
+  INFO_LOG("worker pool: %llu tasks ran inline on a full queue",
+           static_cast<unsigned long long>(inlineRuns()));
+}
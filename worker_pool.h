@@ -0,0 +1,90 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "common.h"
+
+struct WorkerStats {
+  int cpu;  // -1 if not pinned
+  uint64_t tasks;
+  uint64_t steals;  // tasks taken from another worker's queue
+  double busy_ms;
+  double utilization;  // busy time over the pool's lifetime
+};
+
+// tasks submitted together, waited for with WorkerPool::wait
+class TaskGroup {
+ public:
+  TaskGroup() : pending_(0) {}
+
+ private:
+  friend class WorkerPool;
+
+  std::atomic<int> pending_;
+  std::mutex mutex_;
+  std::condition_variable done_cv_;
+};
+
+// Shared CPU workers for per-target pre- and postprocessing of many trackers.
+// Every worker owns a bounded queue; it runs its own tasks newest first and
+// steals the oldest of another worker's when it runs dry. Submitting to a
+// full queue runs the task in the calling thread instead, so a backlog never
+// grows without bound. wait() helps with queued tasks rather than blocking,
+// which also makes it safe to call from a task.
+//
+// Results are as deterministic as the tasks: the pool only decides where and
+// when a task runs, so tasks must not share mutable state.
+class WorkerPool {
+ public:
+  // one worker per entry, pinned to that core; -1 leaves a worker unpinned
+  explicit WorkerPool(const std::vector<int>& cpus,
+                      size_t queue_capacity = 64);
+  ~WorkerPool();
+
+  // from NANOTRACK_WORKER_CPUS, e.g. "0,1,2,3"; null if unset or invalid
+  static std::shared_ptr<WorkerPool> fromEnv();
+
+  void submit(TaskGroup& group, std::function<void()> task);
+  void wait(TaskGroup& group);
+  // body(0) .. body(count - 1), returns when all are done
+  void parallelFor(size_t count, const std::function<void(size_t)>& body);
+
+  size_t size() const { return workers_.size(); }
+  std::vector<WorkerStats> stats() const;
+  // tasks that found their queue full and ran in the submitting thread
+  uint64_t inlineRuns() const { return inline_runs_.load(); }
+  void printStats() const;
+
+ private:
+  struct Task {
+    std::function<void()> run;
+    TaskGroup* group;
+  };
+  struct Worker;
+
+  void workerLoop(size_t index);
+  // own queue first (newest), then the others (oldest); self may be -1
+  bool takeTask(int self, Task& task, bool& stolen);
+  void runTask(Task& task);
+
+  std::vector<std::unique_ptr<Worker>> workers_;
+  size_t queue_capacity_;
+  int64_t start_ns_;
+  std::atomic<size_t> next_worker_;
+  std::atomic<uint64_t> inline_runs_;
+
+  // idle workers sleep here until something is queued
+  std::mutex idle_mutex_;
+  std::condition_variable idle_cv_;
+  std::atomic<size_t> queued_;
+  bool stop_;
+};